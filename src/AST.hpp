@@ -15,6 +15,7 @@
 #include "llvm/IR/Verifier.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
@@ -25,96 +26,258 @@
 
 #include "Lexer.hpp"
 
-#include <memory>
-#include <map>
-#include <utility>
+#include <cstdint>
+#include <span>
+#include <string_view>
 
 namespace DecafParsing {
 
 namespace AST {
 
+enum class ExprKind : std::uint8_t {
+  NUMBER,
+  VARIABLE,
+  BINARY,
+  CALL,
+  IF,
+  WHILE,
+  VAR,
+  INDEX
+};
+
+// Types of values. Unannotated arguments and returns are doubles.
+enum class ValueType : std::uint8_t {
+  DOUBLE,
+  INT,  // Signed 64-bit integer
+  BOOL
+};
+
+// Type both operands of a mixed expression are converted to: bool widens to
+// int and int to double
+constexpr ValueType commonType(ValueType a, ValueType b) {
+  if (a == b)
+    return a;
+  return a == ValueType::DOUBLE || b == ValueType::DOUBLE ? ValueType::DOUBLE : ValueType::INT;
+}
+
+// Type arithmetic is done in; there is no bool arithmetic
+constexpr ValueType arithmeticType(ValueType a, ValueType b) {
+  ValueType type = commonType(a, b);
+  return type == ValueType::BOOL ? ValueType::INT : type;
+}
+
+// Slot or function ID of a name the resolver hasn't bound (yet)
+constexpr std::uint32_t kUnresolved = UINT32_MAX;
+
+// Largest array kept on the stack: 64 KiB of 8-byte elements. Larger ones go
+// on the heap even when their size is a literal.
+constexpr std::uint32_t kMaxStackArrayElements = 8192;
+
+// AST nodes live in the parser's arena and are released together with it, so
+// they are trivially destructible: children are plain arena pointers, lists are
+// spans into the arena and names are interned symbols.
+//
+// Expressions are not polymorphic. Every node carries its kind, and traversals
+// dispatch on it through visit() instead of virtual calls or RTTI.
 struct Expr {
 public:
-  virtual ~Expr() = default;
-  virtual llvm::Value *codegen() = 0;
+  ExprKind kind;
+  ValueType type = ValueType::DOUBLE; // Set by the parser for literals and by the resolver for the rest
+
+  llvm::Value *codegen(); // Dispatches to the codegen() of the concrete node
+
+protected:
+  explicit Expr(ExprKind kind) : kind(kind) {}
+  ~Expr() = default;
 };
 
 struct Prototype {
 public:
-  Prototype(const std::string &name, std::vector<std::string> args)
-    : name(name), args(std::move(args)) {}
+  Prototype(DecafScanning::Symbol name, std::span<const DecafScanning::Symbol> args,
+            std::span<const ValueType> argTypes = {}, ValueType returnType = ValueType::DOUBLE)
+    : name(name), args(args), argTypes(argTypes), returnType(returnType) {}
 
-  const std::string &getName() const { return name; }
-  std::string name;
-  std::vector<std::string> args;
+  std::string_view getName() const { return DecafScanning::Interner::name(name); }
+  DecafScanning::Symbol name;
+  std::span<const DecafScanning::Symbol> args;
+  std::span<const ValueType> argTypes; // Parallel to args
+  ValueType returnType;
+  ValueType argType(std::size_t i) const { return i < argTypes.size() ? argTypes[i] : ValueType::DOUBLE; }
+  std::uint32_t function = kUnresolved; // Program-wide function ID, set by the resolver
+  bool fastMath = false; // Declared `def fast`: floating-point math may be reassociated and contracted
+  bool memoize = false;  // Declared `def memo`: results are cached by argument if the function is pure
   llvm::Function *codegen();
 };
 
 struct Function {
 public:
-  Function(std::unique_ptr<Prototype> proto,
-           std::unique_ptr<Expr> body)
-    : proto(std::move(proto)), body(std::move(body)) {}
-  std::unique_ptr<Prototype> proto;
-  std::unique_ptr<Expr> body;
+  Function(Prototype *proto, Expr *body)
+    : proto(proto), body(body) {}
+  Prototype *proto;
+  Expr *body;
+  std::uint32_t slotCount = 0; // Arguments and locals, set by the resolver
+  bool selfTailCalls = false; // Whether a call in tail position recurses, set by the resolver
   llvm::Function *codegen();
 };
 
 struct NumberExpr : public Expr {
 public:
-  NumberExpr(double value) : value(value) {}
-  llvm::Value *codegen() override;
-  double value;
+  NumberExpr(double value, ValueType type = ValueType::DOUBLE) : Expr(ExprKind::NUMBER), value(value) { this->type = type; }
+  llvm::Value *codegen();
+  double value; // Integral for INT literals, 0 or 1 for BOOL ones
 };
 
 struct VariableExpr : public Expr {
 public:
-  VariableExpr(const std::string &name) : name(name) {}
-  llvm::Value *codegen() override;
-  std::string name;
+  VariableExpr(DecafScanning::Symbol name) : Expr(ExprKind::VARIABLE), name(name) {}
+  llvm::Value *codegen();
+  DecafScanning::Symbol name;
+  std::uint32_t slot = kUnresolved; // Slot of the argument or local it names, set by the resolver
+  std::uint32_t position = 0; // Of the name in the source, for diagnostics
 };
 
 struct BinaryExpr : public Expr {
 public:
-  BinaryExpr(DecafScanning::Token op, std::unique_ptr<Expr> LHS,
-                std::unique_ptr<Expr> RHS)
-    : op(op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
-  llvm::Value *codegen() override;
-  DecafScanning::Token op;
-  std::unique_ptr<Expr> LHS, RHS;
+  BinaryExpr(DecafScanning::Token op, Expr *LHS, Expr *RHS)
+    : Expr(ExprKind::BINARY), op(op), LHS(LHS), RHS(RHS) {}
+  llvm::Value *codegen();
+  DecafScanning::Token op; // Besides the operators, '=' assigns to the variable or element LHS and ';' sequences
+  Expr *LHS, *RHS;
 };
 
 struct CallExpr : public Expr {
 public:
-  CallExpr(const std::string &callee,
-              std::vector<std::unique_ptr<Expr>> args)
-    : callee(callee), args(std::move(args)) {}
-  llvm::Value *codegen() override;
-  std::string callee;
-  std::vector<std::unique_ptr<Expr>> args;
+  CallExpr(DecafScanning::Symbol callee, std::span<Expr*> args)
+    : Expr(ExprKind::CALL), callee(callee), args(args) {}
+  llvm::Value *codegen();
+  DecafScanning::Symbol callee;
+  std::uint32_t function = kUnresolved; // Function ID of the callee, set by the resolver
+  bool tail = false; // Its value is returned as is, set by the resolver
+  std::uint32_t position = 0; // Of the callee's name in the source, for diagnostics
+  std::span<Expr*> args;
 };
 
 class IfExpr: public Expr {
 public:
-  IfExpr(std::unique_ptr<Expr> cond, std::unique_ptr<Expr> then,
-            std::unique_ptr<Expr> else_)
-    : cond(std::move(cond)), then(std::move(then)), else_(std::move(else_)) {}
+  IfExpr(Expr *cond, Expr *then, Expr *else_)
+    : Expr(ExprKind::IF), cond(cond), then(then), else_(else_) {}
 
-  llvm::Value *codegen() override;
-  std::unique_ptr<Expr> cond, then, else_;
+  llvm::Value *codegen();
+  Expr *cond, *then, *else_;
 };
 
 class WhileExpr: public Expr {
 public:
-  WhileExpr(std::unique_ptr<Expr> cond, std::unique_ptr<Expr> body)
-    : cond(std::move(cond)), body(std::move(body)) {}
+  WhileExpr(Expr *cond, Expr *body)
+    : Expr(ExprKind::WHILE), cond(cond), body(body) {}
 
-  llvm::Value *codegen() override;
-  std::unique_ptr<Expr> cond, body;
+  llvm::Value *codegen();
+  Expr *cond, *body;
 };
 
+// Declares a mutable local, initialized to init, whose scope is body: the rest
+// of the sequence it was declared in. An array local has init elements of
+// varType, an int. They are on the stack when init is a literal of at most
+// kMaxStackArrayElements, and are zeroed each time the declaration is reached,
+// like a scalar's initializer, so a declaration inside a loop clears its
+// array on every iteration.
+class VarExpr: public Expr {
+public:
+  VarExpr(DecafScanning::Symbol name, ValueType varType, Expr *init, Expr *body, bool array = false)
+    : Expr(ExprKind::VAR), name(name), varType(varType), array(array), init(init), body(body) {}
+
+  llvm::Value *codegen();
+  DecafScanning::Symbol name;
+  ValueType varType; // Of the elements for arrays
+  bool array;
+  std::uint32_t slot = kUnresolved; // Slot of the local, after the arguments', set by the resolver
+  std::uint32_t position = 0; // Of an array's size in the source, for diagnostics
+  Expr *init, *body;
+  bool onHeap() const {
+    return array && (init->kind != ExprKind::NUMBER || static_cast<const NumberExpr &>(*init).value > kMaxStackArrayElements);
+  }
+};
+
+// Element of an array local
+struct IndexExpr : public Expr {
+public:
+  IndexExpr(DecafScanning::Symbol name, Expr *index)
+    : Expr(ExprKind::INDEX), name(name), index(index) {}
+  llvm::Value *codegen();
+  DecafScanning::Symbol name;
+  std::uint32_t slot = kUnresolved; // Slot of the array, set by the resolver
+  std::uint32_t position = 0; // Of the name in the source, for diagnostics
+  Expr *index;
+};
+
+// Call visitor with expr downcast to its concrete node type
+template<typename Visitor>
+decltype(auto) visit(Expr &expr, Visitor &&visitor) {
+  switch (expr.kind) {
+    case ExprKind::NUMBER:
+      return visitor(static_cast<NumberExpr &>(expr));
+    case ExprKind::VARIABLE:
+      return visitor(static_cast<VariableExpr &>(expr));
+    case ExprKind::BINARY:
+      return visitor(static_cast<BinaryExpr &>(expr));
+    case ExprKind::CALL:
+      return visitor(static_cast<CallExpr &>(expr));
+    case ExprKind::IF:
+      return visitor(static_cast<IfExpr &>(expr));
+    case ExprKind::WHILE:
+      return visitor(static_cast<WhileExpr &>(expr));
+    case ExprKind::VAR:
+      return visitor(static_cast<VarExpr &>(expr));
+    case ExprKind::INDEX:
+      return visitor(static_cast<IndexExpr &>(expr));
+  }
+  llvm_unreachable("Unknown expression kind");
+}
+
+// Call f on each direct child of expr, in source order
+template<typename F>
+void forEachChild(Expr &expr, F &&f) {
+  switch (expr.kind) {
+    case ExprKind::NUMBER:
+    case ExprKind::VARIABLE:
+      break;
+    case ExprKind::BINARY: {
+      auto &binary = static_cast<BinaryExpr &>(expr);
+      f(*binary.LHS);
+      f(*binary.RHS);
+      break;
+    }
+    case ExprKind::CALL:
+      for (Expr *arg : static_cast<CallExpr &>(expr).args)
+        f(*arg);
+      break;
+    case ExprKind::IF: {
+      auto &ifExpr = static_cast<IfExpr &>(expr);
+      f(*ifExpr.cond);
+      f(*ifExpr.then);
+      f(*ifExpr.else_);
+      break;
+    }
+    case ExprKind::WHILE: {
+      auto &whileExpr = static_cast<WhileExpr &>(expr);
+      f(*whileExpr.cond);
+      f(*whileExpr.body);
+      break;
+    }
+    case ExprKind::VAR: {
+      auto &varExpr = static_cast<VarExpr &>(expr);
+      f(*varExpr.init);
+      f(*varExpr.body);
+      break;
+    }
+    case ExprKind::INDEX:
+      f(*static_cast<IndexExpr &>(expr).index);
+      break;
+  }
+}
+
 }
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,27 @@
+#include "Arena.hpp"
+
+namespace DecafMemory {
+
+// Start a new block. Allocations larger than a block get a block of their own,
+// so the current block stays in use for the small ones that follow.
+void* Arena::allocateSlow(std::size_t size, std::size_t alignment) {
+  std::size_t blockSize = size + alignment;
+  bool dedicated = blockSize > m_blockSize;
+  if (!dedicated)
+    blockSize = m_blockSize;
+
+  std::unique_ptr<std::byte[]> block(new std::byte[blockSize]);
+  std::byte* begin = block.get();
+  std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(begin) % alignment) % alignment;
+  std::byte* result = begin + padding;
+
+  m_blocks.push_back(std::move(block));
+  m_reservedBytes += blockSize;
+  if (!dedicated) {
+    m_cursor = result + size;
+    m_end = begin + blockSize;
+  }
+  return result;
+}
+
+}
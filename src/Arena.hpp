@@ -0,0 +1,75 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace DecafMemory {
+
+// Bump allocator handing out memory from large blocks. Objects are never
+// destroyed individually: everything is released at once when the arena is
+// destroyed, so only trivially destructible types may be placed in it.
+class Arena {
+public:
+  static constexpr std::size_t kDefaultBlockSize = 64 * 1024;
+
+  explicit Arena(std::size_t blockSize = kDefaultBlockSize) : m_blockSize(blockSize) {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(std::size_t size, std::size_t alignment) {
+    std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(m_cursor) % alignment) % alignment;
+    if (m_cursor && padding + size <= static_cast<std::size_t>(m_end - m_cursor)) {
+      std::byte* result = m_cursor + padding;
+      m_cursor = result + size;
+      return result;
+    }
+    return allocateSlow(size, alignment);
+  }
+
+  template<typename T, typename... Args>
+  T* make(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>, "Arena objects are released without running their destructor");
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Copy a range of trivially copyable values into the arena
+  template<typename T>
+  std::span<T> copyArray(std::span<const T> items) {
+    static_assert(std::is_trivially_copyable_v<T>, "Arena arrays are copied bytewise");
+    if (items.empty())
+      return {};
+    T* result = static_cast<T*>(allocate(items.size_bytes(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), result);
+    return { result, items.size() };
+  }
+
+  std::string_view copyString(std::string_view text) {
+    std::span<const char> copy = copyArray(std::span<const char>(text.data(), text.size()));
+    return { copy.data(), copy.size() };
+  }
+
+  // Bytes obtained from the system, including unused space at the end of blocks
+  std::size_t reservedBytes() const { return m_reservedBytes; }
+
+private:
+  std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+  std::byte* m_cursor = nullptr;
+  std::byte* m_end = nullptr;
+  std::size_t m_blockSize;
+  std::size_t m_reservedBytes = 0;
+
+  void* allocateSlow(std::size_t size, std::size_t alignment);
+};
+
+}
+
+#endif // ARENA_H
@@ -1,144 +1,567 @@
 #include "CodeGenerator.hpp"
+#include "ConstantFolder.hpp"
 #include "Lexer.hpp"
 #include "Logger.hpp"
 #include "JIT.hpp"
 
-#define DEBUG_LINE std::cout << __LINE__ << " ran." << std::endl;
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Transforms/Scalar/LICM.h"
+#include "llvm/Transforms/Scalar/LoopLoadElimination.h"
+#include "llvm/Transforms/Scalar/LoopPassManager.h"
+#include "llvm/Transforms/Scalar/LoopRotation.h"
+#include "llvm/Transforms/Scalar/LoopUnrollPass.h"
+#include "llvm/Transforms/Utils/LCSSA.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Vectorize/LoopVectorize.h"
+#include "llvm/Transforms/Vectorize/SLPVectorizer.h"
+#include "llvm/Transforms/Vectorize/VectorCombine.h"
+
+#include <algorithm>
+#include <cassert>
 
 using namespace DecafCodeGen;
 using namespace DecafScanning;
 
+namespace {
+
+llvm::OptimizationLevel passLevel(OptLevel level) {
+  switch (level) {
+    case OptLevel::O0: return llvm::OptimizationLevel::O0;
+    case OptLevel::O1: return llvm::OptimizationLevel::O1;
+    case OptLevel::O2: return llvm::OptimizationLevel::O2;
+    case OptLevel::O3: return llvm::OptimizationLevel::O3;
+    case OptLevel::Os: return llvm::OptimizationLevel::Os;
+  }
+  llvm_unreachable("Unknown optimization level");
+}
+
+// Vectorize from -O2 on, as clang does
+llvm::PipelineTuningOptions tuningOptions(OptLevel level) {
+  llvm::PipelineTuningOptions PTO;
+  PTO.LoopVectorization = level == OptLevel::O2 || level == OptLevel::O3 || level == OptLevel::Os;
+  PTO.SLPVectorization = PTO.LoopVectorization;
+  return PTO;
+}
+
+}
+
 // Open a new context and module.
 std::unique_ptr<llvm::LLVMContext> CodeGenerator::context;
 std::unique_ptr<llvm::Module> CodeGenerator::module_;
 
 // Create a new builder for the module.
 std::unique_ptr<llvm::IRBuilder<>> CodeGenerator::builder;
-std::map<std::string, llvm::Value*> CodeGenerator::namedValues;
-std::map<std::string, std::unique_ptr<DecafParsing::AST::Prototype>> CodeGenerator::functionProtos;
-
-std::unique_ptr<llvm::FunctionPassManager> CodeGenerator::FPM = std::make_unique<llvm::FunctionPassManager>();
-std::unique_ptr<llvm::LoopAnalysisManager> CodeGenerator::LAM = std::make_unique<llvm::LoopAnalysisManager>();
-std::unique_ptr<llvm::FunctionAnalysisManager> CodeGenerator::FAM = std::make_unique<llvm::FunctionAnalysisManager>();
-std::unique_ptr<llvm::CGSCCAnalysisManager> CodeGenerator::CGAM = std::make_unique<llvm::CGSCCAnalysisManager>();
-std::unique_ptr<llvm::ModuleAnalysisManager> CodeGenerator::MAM = std::make_unique<llvm::ModuleAnalysisManager>();
-std::unique_ptr<llvm::PassInstrumentationCallbacks> CodeGenerator::PIC = std::make_unique<llvm::PassInstrumentationCallbacks>();
+DecafParsing::Resolver CodeGenerator::resolver;
+DecafParsing::PurityAnalysis CodeGenerator::purity;
+bool CodeGenerator::memoizePureFunctions = false;
+bool CodeGenerator::fastMath = false;
+OptLevel CodeGenerator::optLevel = OptLevel::O2;
+bool CodeGenerator::wholeProgram = false;
+std::vector<llvm::Value*> CodeGenerator::namedValues;
+std::vector<DecafParsing::AST::Prototype*> CodeGenerator::functionProtos;
+std::vector<llvm::Function*> CodeGenerator::moduleFunctions;
+std::uint32_t CodeGenerator::currentFunction = DecafParsing::AST::kUnresolved;
+llvm::BasicBlock *CodeGenerator::tailRecurseBlock = nullptr;
+
+std::unique_ptr<llvm::FunctionPassManager> CodeGenerator::FPM;
+std::unique_ptr<llvm::LoopAnalysisManager> CodeGenerator::LAM;
+std::unique_ptr<llvm::FunctionAnalysisManager> CodeGenerator::FAM;
+std::unique_ptr<llvm::CGSCCAnalysisManager> CodeGenerator::CGAM;
+std::unique_ptr<llvm::ModuleAnalysisManager> CodeGenerator::MAM;
+std::unique_ptr<llvm::PassInstrumentationCallbacks> CodeGenerator::PIC;
 std::unique_ptr<llvm::StandardInstrumentations> CodeGenerator::SI;
-llvm::PassBuilder CodeGenerator::PB;
+std::unique_ptr<llvm::PassBuilder> CodeGenerator::PB;
+
+std::optional<OptLevel> CodeGenerator::parseOptLevel(std::string_view flag) {
+  static constexpr std::pair<std::string_view, OptLevel> kFlags[] = {
+    { "-O0", OptLevel::O0 }, { "-O1", OptLevel::O1 }, { "-O2", OptLevel::O2 },
+    { "-O3", OptLevel::O3 }, { "-Os", OptLevel::Os },
+  };
+  for (const auto& [name, level] : kFlags) {
+    if (flag == name)
+      return level;
+  }
+  return std::nullopt;
+}
 
-llvm::Function *getFunction(std::string name) {
+llvm::Function *getFunction(std::uint32_t id) {
   // First, see if the function has already been added to the current module.
-  if (auto *F = CodeGenerator::module_->getFunction(name))
-    return F;
+  if (id < CodeGenerator::moduleFunctions.size() && CodeGenerator::moduleFunctions[id])
+    return CodeGenerator::moduleFunctions[id];
 
   // If not, check whether we can codegen the declaration from some existing
   // prototype.
-  auto FI = CodeGenerator::functionProtos.find(name);
-  if (FI != CodeGenerator::functionProtos.end())
-    return FI->second->codegen();
+  if (id < CodeGenerator::functionProtos.size() && CodeGenerator::functionProtos[id])
+    return CodeGenerator::functionProtos[id]->codegen();
 
   // If no existing prototype exists, return null.
   return nullptr;
 }
 
+void CodeGenerator::reset() {
+  CodeGenerator::resolver.clear();
+  CodeGenerator::purity.clear();
+  CodeGenerator::functionProtos.clear();
+  CodeGenerator::moduleFunctions.clear();
+}
+
 void CodeGenerator::initializeModuleAndPassManager() {
   // Open a new context and module.
   CodeGenerator::context = std::make_unique<llvm::LLVMContext>();
   CodeGenerator::module_ = std::make_unique<llvm::Module>("LASIL_JIT", *CodeGenerator::context);
   CodeGenerator::module_->setDataLayout(DecafJIT::JIT::JIT_->getDataLayout());
+  CodeGenerator::moduleFunctions.clear();
+  CodeGenerator::wholeProgram = false;
 
   // Create a new builder for the module.
   CodeGenerator::builder = std::make_unique<llvm::IRBuilder<>>(*CodeGenerator::context);
 
-  CodeGenerator::SI = std::make_unique<llvm::StandardInstrumentations>(*CodeGenerator::context, /*DebugLogging*/ true);
+  // Fresh managers for every module. Appending to the previous pass manager
+  // would run the pipeline once more per module generated so far.
+  CodeGenerator::FPM = std::make_unique<llvm::FunctionPassManager>();
+  CodeGenerator::LAM = std::make_unique<llvm::LoopAnalysisManager>();
+  CodeGenerator::FAM = std::make_unique<llvm::FunctionAnalysisManager>();
+  CodeGenerator::CGAM = std::make_unique<llvm::CGSCCAnalysisManager>();
+  CodeGenerator::MAM = std::make_unique<llvm::ModuleAnalysisManager>();
+  CodeGenerator::PIC = std::make_unique<llvm::PassInstrumentationCallbacks>();
+  CodeGenerator::SI = std::make_unique<llvm::StandardInstrumentations>(*CodeGenerator::context, /*DebugLogging*/ DecafLogger::Logger::isTracing(DecafLogger::TraceCategory::CODEGEN));
   CodeGenerator::SI->registerCallbacks(*CodeGenerator::PIC, CodeGenerator::FAM.get());
 
-  // Add transform passes.
-  // Do simple "peephole" optimizations and bit-twiddling optzns.
-  CodeGenerator::FPM->addPass(llvm::InstCombinePass());
-  // Reassociate expressions.
-  CodeGenerator::FPM->addPass(llvm::ReassociatePass());
-  // Eliminate Common SubExpressions.
-  CodeGenerator::FPM->addPass(llvm::GVNPass());
-  // Simplify the control flow graph (deleting unreachable blocks, etc).
-  CodeGenerator::FPM->addPass(llvm::SimplifyCFGPass());
+  // With the JIT's target machine the passes see the host's real costs
+  CodeGenerator::PB = std::make_unique<llvm::PassBuilder>(&DecafJIT::JIT::JIT_->getTargetMachine(), tuningOptions(CodeGenerator::optLevel),
+                                                          std::nullopt, CodeGenerator::PIC.get());
+
+  // Register analysis passes used in the transform passes.
+  CodeGenerator::PB->registerModuleAnalyses(*CodeGenerator::MAM);
+  CodeGenerator::PB->registerCGSCCAnalyses(*CodeGenerator::CGAM);
+  CodeGenerator::PB->registerFunctionAnalyses(*CodeGenerator::FAM);
+  CodeGenerator::PB->registerLoopAnalyses(*CodeGenerator::LAM);
+  CodeGenerator::PB->crossRegisterProxies(*CodeGenerator::LAM, *CodeGenerator::FAM, *CodeGenerator::CGAM, *CodeGenerator::MAM);
+
+  // Add transform passes: LLVM's own per-function pipeline for the level, or none at -O0
+  if (CodeGenerator::optLevel != OptLevel::O0) {
+    *CodeGenerator::FPM = CodeGenerator::PB->buildFunctionSimplificationPipeline(passLevel(CodeGenerator::optLevel), llvm::ThinOrFullLTOPhase::None);
+    addLoopOptimizationPasses(*CodeGenerator::FPM);
+  }
+}
+
+// The simplification pipeline already canonicalizes loops and runs LICM,
+// IndVarSimplify, unswitching and full unrolling on them. What the module
+// pipeline would add afterwards is vectorization and partial and runtime
+// unrolling; functions generated one at a time get them here.
+void CodeGenerator::addLoopOptimizationPasses(llvm::FunctionPassManager &FPM) {
+  llvm::PipelineTuningOptions PTO = tuningOptions(CodeGenerator::optLevel);
+
+  // Canonical form: a preheader and a single latch, values leaving the loop
+  // through PHIs at its exits and the exit test at the bottom
+  FPM.addPass(llvm::LoopSimplifyPass());
+  FPM.addPass(llvm::LCSSAPass());
+  FPM.addPass(llvm::createFunctionToLoopPassAdaptor(llvm::LoopRotatePass(CodeGenerator::optLevel != OptLevel::Os), /*UseMemorySSA*/ false));
+
+  // Vectorize innermost loops, then clean up the runtime checks and the
+  // vector code itself
+  FPM.addPass(llvm::LoopVectorizePass(llvm::LoopVectorizeOptions(!PTO.LoopInterleaving, !PTO.LoopVectorization)));
+  FPM.addPass(llvm::LoopLoadEliminationPass());
+  FPM.addPass(llvm::InstCombinePass());
+  FPM.addPass(llvm::SimplifyCFGPass());
+  if (PTO.SLPVectorization)
+    FPM.addPass(llvm::SLPVectorizerPass());
+  FPM.addPass(llvm::VectorCombinePass());
+  FPM.addPass(llvm::InstCombinePass());
+
+  // Unroll what is left by the target's preferences, and hoist what that exposes
+  FPM.addPass(llvm::LoopUnrollPass(llvm::LoopUnrollOptions(passLevel(CodeGenerator::optLevel).getSpeedupLevel(), /*OnlyWhenForced*/ !PTO.LoopUnrolling,
+                                                           PTO.ForgetAllSCEVInLoopUnroll)));
+  FPM.addPass(llvm::InstCombinePass());
+  FPM.addPass(llvm::RequireAnalysisPass<llvm::OptimizationRemarkEmitterAnalysis, llvm::Function>());
+  FPM.addPass(llvm::createFunctionToLoopPassAdaptor(llvm::LICMPass(llvm::LICMOptions()), /*UseMemorySSA*/ true));
+  FPM.addPass(llvm::SimplifyCFGPass());
+}
+
+// Let LLVM merge and drop calls to functions known to be free of side effects
+void CodeGenerator::addEffectAttributes(llvm::Function *function, const DecafParsing::FunctionEffects &effects) {
+  if (!effects.pure)
+    return;
+  function->setDoesNotThrow();
+  if (!effects.accessesMemory)
+    function->setDoesNotAccessMemory();
+  if (effects.willReturn)
+    function->setWillReturn();
+}
+
+void CodeGenerator::declare(DecafParsing::AST::Prototype &proto) {
+  CodeGenerator::resolver.declare(proto);
+  if (proto.function >= CodeGenerator::functionProtos.size())
+    CodeGenerator::functionProtos.resize(proto.function + 1);
+  CodeGenerator::functionProtos[proto.function] = &proto;
+}
+
+void CodeGenerator::optimizeProgram(const std::vector<llvm::Function*> &entryPoints) {
+  for (llvm::Function &F : *CodeGenerator::module_) {
+    if (F.isDeclaration() || llvm::is_contained(entryPoints, &F))
+      continue;
+    F.setLinkage(llvm::GlobalValue::InternalLinkage);
+    F.setCallingConv(llvm::CallingConv::Fast);
+  }
+
+  // Call sites have to agree with their callee's convention. A guaranteed tail
+  // call additionally needs the caller's to match, so calls from the entry
+  // points fall back to plain tail calls.
+  for (llvm::Function &F : *CodeGenerator::module_) {
+    for (llvm::BasicBlock &BB : F) {
+      for (llvm::Instruction &I : BB) {
+        auto *call = llvm::dyn_cast<llvm::CallInst>(&I);
+        llvm::Function *callee = call ? call->getCalledFunction() : nullptr;
+        if (!callee)
+          continue;
+        call->setCallingConv(callee->getCallingConv());
+        if (call->isMustTailCall() && callee->getCallingConv() != F.getCallingConv())
+          call->setTailCallKind(llvm::CallInst::TCK_Tail);
+      }
+    }
+  }
+
+  // LLVM's module pipeline propagates constant arguments, inlines the small
+  // helpers into their callers, cleans up the result and drops the functions
+  // nothing calls anymore
+  if (CodeGenerator::optLevel != OptLevel::O0) {
+    llvm::ModulePassManager MPM = CodeGenerator::PB->buildPerModuleDefaultPipeline(passLevel(CodeGenerator::optLevel));
+    MPM.run(*CodeGenerator::module_, *CodeGenerator::MAM);
+  }
+
+  DECAF_TRACE(IR_AFTER,
+    DecafLogger::Logger::trace(DecafLogger::TraceCategory::IR_AFTER, "Optimized program");
+    CodeGenerator::module_->print(llvm::errs(), nullptr));
+}
+
+llvm::Type *CodeGenerator::llvmType(DecafParsing::AST::ValueType type) {
+  switch (type) {
+    case DecafParsing::AST::ValueType::DOUBLE:
+      return llvm::Type::getDoubleTy(*CodeGenerator::context);
+    case DecafParsing::AST::ValueType::INT:
+      return llvm::Type::getInt64Ty(*CodeGenerator::context);
+    case DecafParsing::AST::ValueType::BOOL:
+      return llvm::Type::getInt1Ty(*CodeGenerator::context);
+  }
+  llvm_unreachable("Unknown value type");
+}
+
+llvm::Value *CodeGenerator::convert(llvm::Value *value, DecafParsing::AST::ValueType from, DecafParsing::AST::ValueType to) {
+  using DecafParsing::AST::ValueType;
+  if (from == to)
+    return value;
+
+  switch (to) {
+    case ValueType::DOUBLE:
+      return from == ValueType::INT ? CodeGenerator::builder->CreateSIToFP(value, llvmType(to), "inttofp")
+                                    : CodeGenerator::builder->CreateUIToFP(value, llvmType(to), "booltofp");
+    case ValueType::INT:
+      return from == ValueType::DOUBLE ? CodeGenerator::builder->CreateFPToSI(value, llvmType(to), "fptoint")
+                                       : CodeGenerator::builder->CreateZExt(value, llvmType(to), "booltoint");
+    case ValueType::BOOL: // Nonzero is true; NaN is false
+      return from == ValueType::DOUBLE
+        ? CodeGenerator::builder->CreateFCmpONE(value, llvm::ConstantFP::get(*CodeGenerator::context, llvm::APFloat(0.0)), "tobool")
+        : CodeGenerator::builder->CreateICmpNE(value, llvm::ConstantInt::get(llvmType(from), 0), "tobool");
+  }
+  llvm_unreachable("Unknown value type");
+}
+
+namespace {
+
+// Memo tables are direct-mapped: an entry is only kept until another
+// argument list hashes to its slot
+constexpr unsigned kMemoTableBits = 12;
+constexpr std::uint64_t kMemoTableSize = std::uint64_t(1) << kMemoTableBits;
+
+}
+
+llvm::Function *CodeGenerator::memoize(llvm::Function *function) {
+  llvm::LLVMContext &ctx = *CodeGenerator::context;
+  llvm::IRBuilder<> &B = *CodeGenerator::builder;
+  std::string name = function->getName().str();
+
+  // Recursive calls inside the body go through the table as well
+  llvm::Function *wrapper = llvm::Function::Create(function->getFunctionType(), llvm::Function::ExternalLinkage, "", CodeGenerator::module_.get());
+  function->replaceAllUsesWith(wrapper);
+  function->setName(name + ".impl");
+  function->setLinkage(llvm::Function::InternalLinkage);
+  wrapper->setName(name);
+  wrapper->setCallingConv(function->getCallingConv());
+  wrapper->setAttributes(function->getAttributes());
+
+  llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::Type *i8 = llvm::Type::getInt8Ty(ctx);
+  llvm::Type *returnType = function->getReturnType();
+  auto makeTable = [&](llvm::Type *elementType, const char *suffix) {
+    llvm::ArrayType *tableType = llvm::ArrayType::get(elementType, kMemoTableSize);
+    return new llvm::GlobalVariable(*CodeGenerator::module_, tableType, /*isConstant*/ false, llvm::GlobalValue::InternalLinkage,
+                                    llvm::Constant::getNullValue(tableType), name + suffix);
+  };
+  llvm::GlobalVariable *keys = makeTable(llvm::ArrayType::get(i64, function->arg_size()), ".memo.keys");
+  llvm::GlobalVariable *values = makeTable(returnType, ".memo.values");
+  llvm::GlobalVariable *filled = makeTable(i8, ".memo.filled");
+
+  llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(ctx, "entry", wrapper);
+  llvm::BasicBlock *hitBB = llvm::BasicBlock::Create(ctx, "hit", wrapper);
+  llvm::BasicBlock *missBB = llvm::BasicBlock::Create(ctx, "miss", wrapper);
+
+  // Key on the bits of the arguments, so e.g. 0.0 and -0.0 stay apart
+  B.SetInsertPoint(entryBB);
+  std::vector<llvm::Value *> args, bits;
+  llvm::Value *hash = llvm::ConstantInt::get(i64, 0);
+  for (auto &arg : wrapper->args()) {
+    llvm::Value *key = arg.getType()->isDoubleTy() ? B.CreateBitCast(&arg, i64) : B.CreateZExt(&arg, i64);
+    args.push_back(&arg);
+    bits.push_back(key);
+    hash = B.CreateMul(B.CreateXor(hash, key), llvm::ConstantInt::get(i64, 0x9E3779B97F4A7C15), "hash");
+  }
+  llvm::Value *zero = llvm::ConstantInt::get(i64, 0);
+  llvm::Value *index = B.CreateLShr(hash, 64 - kMemoTableBits, "slot");
+
+  llvm::Value *filledPtr = B.CreateInBoundsGEP(filled->getValueType(), filled, { zero, index });
+  llvm::Value *match = B.CreateICmpNE(B.CreateLoad(i8, filledPtr), llvm::ConstantInt::get(i8, 0));
+  std::vector<llvm::Value *> keyPtrs;
+  for (unsigned i = 0; i < bits.size(); i++) {
+    keyPtrs.push_back(B.CreateInBoundsGEP(keys->getValueType(), keys, { zero, index, B.getInt32(i) }));
+    match = B.CreateAnd(match, B.CreateICmpEQ(B.CreateLoad(i64, keyPtrs.back()), bits[i]));
+  }
+  llvm::Value *valuePtr = B.CreateInBoundsGEP(values->getValueType(), values, { zero, index });
+  B.CreateCondBr(match, hitBB, missBB);
+
+  B.SetInsertPoint(hitBB);
+  B.CreateRet(B.CreateLoad(returnType, valuePtr, "memo"));
+
+  B.SetInsertPoint(missBB);
+  llvm::CallInst *result = B.CreateCall(function, args, "result");
+  result->setCallingConv(function->getCallingConv());
+  for (unsigned i = 0; i < bits.size(); i++)
+    B.CreateStore(bits[i], keyPtrs[i]);
+  B.CreateStore(result, valuePtr);
+  B.CreateStore(llvm::ConstantInt::get(i8, 1), filledPtr);
+  B.CreateRet(result);
+
+  return wrapper;
+}
+
+namespace {
+
+// Arrays start on a cache line, so vectorized loops over them need no peeling
+// for alignment at any vector width up to 512 bits
+constexpr std::uint64_t kArrayAlignment = 64;
+
+}
+
+// Allocas outside the entry block aren't promoted, so they all go there.
+// Arrays of a fixed size are too, as a static alloca is free to allocate.
+llvm::AllocaInst *CodeGenerator::createEntryBlockAlloca(llvm::Function *function, DecafParsing::AST::ValueType type, llvm::StringRef name,
+                                                        std::uint64_t count) {
+  llvm::IRBuilder<> entryBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
+  if (count == 1)
+    return entryBuilder.CreateAlloca(llvmType(type), nullptr, name);
+  llvm::AllocaInst *array = entryBuilder.CreateAlloca(llvm::ArrayType::get(llvmType(type), count), nullptr, name);
+  array->setAlignment(llvm::Align(kArrayAlignment));
+  return array;
+}
+
+llvm::Value *CodeGenerator::allocateArray(llvm::Value *count, DecafParsing::AST::ValueType type, llvm::StringRef name) {
+  llvm::IRBuilder<> &B = *CodeGenerator::builder;
+  llvm::Type *i64 = B.getInt64Ty();
+  llvm::FunctionCallee alignedAlloc = CodeGenerator::module_->getOrInsertFunction("aligned_alloc", B.getPtrTy(), i64, i64);
+
+  // An empty or negative size still gets one element, as on the stack
+  llvm::Value *one = llvm::ConstantInt::get(i64, 1);
+  count = B.CreateSelect(B.CreateICmpSLT(count, one), one, count, "count");
+
+  // aligned_alloc() wants a multiple of the alignment. A size that doesn't fit
+  // in 64 bits asks for more than any allocator has instead of wrapping around.
+  std::uint64_t elementSize = CodeGenerator::module_->getDataLayout().getTypeAllocSize(llvmType(type));
+  llvm::Value *maxCount = llvm::ConstantInt::get(i64, (UINT64_MAX - kArrayAlignment) / elementSize);
+  llvm::Value *bytes = B.CreateMul(count, llvm::ConstantInt::get(i64, elementSize), "bytes");
+  bytes = B.CreateAnd(B.CreateAdd(bytes, llvm::ConstantInt::get(i64, kArrayAlignment - 1)), llvm::ConstantInt::get(i64, ~(kArrayAlignment - 1)));
+  bytes = B.CreateSelect(B.CreateICmpUGT(count, maxCount), llvm::ConstantInt::get(i64, ~(kArrayAlignment - 1)), bytes, "bytes");
+
+  // Fresh memory that nothing else points to, aligned like the stack arrays
+  llvm::CallInst *array = B.CreateCall(alignedAlloc, { llvm::ConstantInt::get(i64, kArrayAlignment), bytes }, name);
+  array->addRetAttr(llvm::Attribute::NoAlias);
+  array->addRetAttr(llvm::Attribute::getWithAlignment(*CodeGenerator::context, llvm::Align(kArrayAlignment)));
+
+  // Running out of memory traps rather than writing through null
+  llvm::Function *function = B.GetInsertBlock()->getParent();
+  llvm::BasicBlock *failedBB = llvm::BasicBlock::Create(*CodeGenerator::context, "allocfailed", function);
+  llvm::BasicBlock *allocatedBB = llvm::BasicBlock::Create(*CodeGenerator::context, "allocated", function);
+  B.CreateCondBr(B.CreateIsNull(array), failedBB, allocatedBB);
+  B.SetInsertPoint(failedBB);
+  B.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+  B.CreateUnreachable();
+
+  B.SetInsertPoint(allocatedBB);
+  B.CreateMemSet(array, B.getInt8(0), bytes, llvm::MaybeAlign(kArrayAlignment));
+  return array;
+}
 
-  // Register analysis passes used in these transform passes.
-  CodeGenerator::PB.registerModuleAnalyses(*CodeGenerator::MAM);
-  CodeGenerator::PB.registerFunctionAnalyses(*CodeGenerator::FAM);
-  CodeGenerator::PB.crossRegisterProxies(*CodeGenerator::LAM, *CodeGenerator::FAM, *CodeGenerator::CGAM, *CodeGenerator::MAM);
+void CodeGenerator::freeArray(llvm::Value *array) {
+  llvm::IRBuilder<> &B = *CodeGenerator::builder;
+  llvm::FunctionCallee freeFn = CodeGenerator::module_->getOrInsertFunction("free", B.getVoidTy(), B.getPtrTy());
+  B.CreateCall(freeFn, { array });
+}
+
+llvm::Value *CodeGenerator::elementPointer(DecafParsing::AST::IndexExpr &expr) {
+  // The resolver rejects functions that index anything but an array in scope
+  assert(expr.slot < CodeGenerator::namedValues.size() && CodeGenerator::namedValues[expr.slot]);
+  llvm::Value *array = CodeGenerator::namedValues[expr.slot];
+  llvm::Value *index = expr.index->codegen();
+  if (!index)
+    return nullptr;
+  index = convert(index, expr.index->type, DecafParsing::AST::ValueType::INT);
+  // In bounds: indexing outside the array is undefined, which lets the
+  // vectorizers reason about the addresses as plain i64 arithmetic
+  return CodeGenerator::builder->CreateInBoundsGEP(llvmType(expr.type), array, index, "elem");
+}
+
+llvm::Value *CodeGenerator::condition(DecafParsing::AST::Expr &expr) {
+  llvm::Value *value = expr.codegen();
+  if (!value)
+    return nullptr;
+  return convert(value, expr.type, DecafParsing::AST::ValueType::BOOL);
 }
 
 namespace DecafParsing {
 
 namespace AST {
 
+llvm::Value *Expr::codegen() {
+  return visit(*this, [](auto &node) { return node.codegen(); });
+}
+
 llvm::Value *NumberExpr::codegen() {
-  return llvm::ConstantFP::get(*CodeGenerator::context, llvm::APFloat(value));
+  if (type == ValueType::DOUBLE)
+    return llvm::ConstantFP::get(*CodeGenerator::context, llvm::APFloat(value));
+  return llvm::ConstantInt::get(CodeGenerator::llvmType(type), static_cast<std::int64_t>(value), /*IsSigned*/ true);
 }
 
 llvm::Value *VariableExpr::codegen() {
-  // Look this variable up in the function.
-  llvm::Value *V = CodeGenerator::namedValues[name];
-  if (!V)
-    std::cout << "Unknown variable name" << std::endl; // To-do: Log error
-  return V;
+  // The resolver rejects functions that read anything but a variable in scope
+  assert(slot < CodeGenerator::namedValues.size() && CodeGenerator::namedValues[slot]);
+  llvm::Value *A = CodeGenerator::namedValues[slot];
+  return CodeGenerator::builder->CreateLoad(CodeGenerator::llvmType(type), A, DecafScanning::Interner::name(name));
+}
+
+llvm::Value *IndexExpr::codegen() {
+  llvm::Value *element = CodeGenerator::elementPointer(*this);
+  if (!element)
+    return nullptr;
+  return CodeGenerator::builder->CreateLoad(CodeGenerator::llvmType(type), element, "elemval");
 }
 
 llvm::Value *BinaryExpr::codegen() {
+  if (op.type == TokenType::SEMICOLON) {
+    if (!LHS->codegen())
+      return nullptr;
+    return RHS->codegen();
+  }
+
+  if (op.type == TokenType::EQUAL) {
+    llvm::Value *A = nullptr;
+    if (LHS->kind == ExprKind::INDEX) {
+      A = CodeGenerator::elementPointer(static_cast<IndexExpr &>(*LHS));
+      if (!A)
+        return nullptr;
+    } else {
+      // The resolver rejects functions that assign to anything but a variable in scope
+      auto &variable = static_cast<VariableExpr &>(*LHS);
+      assert(variable.slot < CodeGenerator::namedValues.size() && CodeGenerator::namedValues[variable.slot]);
+      A = CodeGenerator::namedValues[variable.slot];
+    }
+    llvm::Value *V = RHS->codegen();
+    if (!V)
+      return nullptr;
+    V = CodeGenerator::convert(V, RHS->type, type);
+    CodeGenerator::builder->CreateStore(V, A);
+    return V;
+  }
+
   llvm::Value *L = LHS->codegen();
   llvm::Value *R = RHS->codegen();
   if (!L || !R)
     return nullptr;
 
+  // Both operands are converted to the type the operation is done in
+  ValueType operandType = arithmeticType(LHS->type, RHS->type);
+  L = CodeGenerator::convert(L, LHS->type, operandType);
+  R = CodeGenerator::convert(R, RHS->type, operandType);
+  bool integer = operandType == ValueType::INT;
+
   switch (op.type) {
     case TokenType::PLUS:
-      return CodeGenerator::builder->CreateFAdd(L, R, "addtmp");
+      return integer ? CodeGenerator::builder->CreateAdd(L, R, "addtmp") : CodeGenerator::builder->CreateFAdd(L, R, "addtmp");
     case TokenType::MINUS:
-      return CodeGenerator::builder->CreateFSub(L, R, "subtmp");
+      return integer ? CodeGenerator::builder->CreateSub(L, R, "subtmp") : CodeGenerator::builder->CreateFSub(L, R, "subtmp");
     case TokenType::TIMES:
-      return CodeGenerator::builder->CreateFMul(L, R, "multmp");
+      return integer ? CodeGenerator::builder->CreateMul(L, R, "multmp") : CodeGenerator::builder->CreateFMul(L, R, "multmp");
+    case TokenType::DIVIDE:
+      return integer ? CodeGenerator::builder->CreateSDiv(L, R, "divtmp") : CodeGenerator::builder->CreateFDiv(L, R, "divtmp");
+    // Double comparisons are unordered, so they hold when either side is NaN
     case TokenType::LESS_THAN:
-      L = CodeGenerator::builder->CreateFCmpULT(L, R, "cmptmp");
-      // Convert bool 0/1 to double 0.0 or 1.0
-      return CodeGenerator::builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*CodeGenerator::context),
-                                  "booltmp");
-    // default:
-    //   return LogErrorV("invalid binary operator");
+      return integer ? CodeGenerator::builder->CreateICmpSLT(L, R, "cmptmp") : CodeGenerator::builder->CreateFCmpULT(L, R, "cmptmp");
+    case TokenType::GREATER_THAN:
+      return integer ? CodeGenerator::builder->CreateICmpSGT(L, R, "cmptmp") : CodeGenerator::builder->CreateFCmpUGT(L, R, "cmptmp");
+    case TokenType::LESS_THAN_EQUAL:
+      return integer ? CodeGenerator::builder->CreateICmpSLE(L, R, "cmptmp") : CodeGenerator::builder->CreateFCmpULE(L, R, "cmptmp");
+    case TokenType::GREATER_THAN_EQUAL:
+      return integer ? CodeGenerator::builder->CreateICmpSGE(L, R, "cmptmp") : CodeGenerator::builder->CreateFCmpUGE(L, R, "cmptmp");
+    case TokenType::EQUAL_EQUAL:
+      return integer ? CodeGenerator::builder->CreateICmpEQ(L, R, "cmptmp") : CodeGenerator::builder->CreateFCmpUEQ(L, R, "cmptmp");
+    default:
+      llvm_unreachable("The parser only builds binary expressions from operators");
   }
-
-  return nullptr; // To-do fix switch default
 }
 
 llvm::Value *CallExpr::codegen() {
-  // Look up the name in the global module table.
-  llvm::Function *calleeF = getFunction(callee);
-  if (!calleeF) std::cout << "Unknown function referenced" << std::endl; // To-do: Throw error
-  //   return LogErrorV("Unknown function referenced");
-
-  // // If argument mismatch error.
-  // if (calleeF->arg_size() != Args.size())
-  //   return LogErrorV("Incorrect # arguments passed");
+  // The resolver rejects calls to unknown functions and calls with the wrong
+  // number of arguments, so this only fails when the callee failed to generate
+  llvm::Function *calleeF = getFunction(function);
+  if (!calleeF)
+    return nullptr;
 
+  // Arguments are converted to the parameter types of the callee
+  Prototype *calleeProto = CodeGenerator::functionProtos[function];
   std::vector<llvm::Value *> argsV;
   for (unsigned i = 0, e = args.size(); i != e; ++i) {
-    argsV.push_back(args[i]->codegen());
-    if (!argsV.back())
+    llvm::Value *argV = args[i]->codegen();
+    if (!argV)
       return nullptr;
+    argsV.push_back(CodeGenerator::convert(argV, args[i]->type, calleeProto->argType(i)));
+  }
+
+  if (!tail)
+    return CodeGenerator::builder->CreateCall(calleeF, argsV, "calltmp");
+
+  // A self tail call becomes a jump back to the top of the function with the
+  // new arguments, so recursion runs in constant stack space. They are all
+  // evaluated before any is stored.
+  if (function == CodeGenerator::currentFunction && CodeGenerator::tailRecurseBlock && argsV.size() == calleeF->arg_size()) {
+    for (std::size_t i = 0; i < argsV.size(); i++)
+      CodeGenerator::builder->CreateStore(argsV[i], CodeGenerator::namedValues[i]);
+    CodeGenerator::builder->CreateBr(CodeGenerator::tailRecurseBlock);
+    return llvm::PoisonValue::get(CodeGenerator::llvmType(type));
   }
 
-  return CodeGenerator::builder->CreateCall(calleeF, argsV, "calltmp");
+  // Other tail calls return the callee's result directly. The call is
+  // guaranteed to reuse the frame when both functions have the same signature.
+  llvm::Function *callerF = CodeGenerator::builder->GetInsertBlock()->getParent();
+  llvm::CallInst *call = CodeGenerator::builder->CreateCall(calleeF, argsV, "calltmp");
+  call->setCallingConv(calleeF->getCallingConv());
+  call->setTailCallKind(calleeF->getFunctionType() == callerF->getFunctionType() && calleeF->getCallingConv() == callerF->getCallingConv()
+                          ? llvm::CallInst::TCK_MustTail : llvm::CallInst::TCK_Tail);
+  CodeGenerator::builder->CreateRet(call);
+  return call;
 }
 
 llvm::Value *IfExpr::codegen() {
-  llvm::Value *condV = cond->codegen();
+  llvm::Value *condV = CodeGenerator::condition(*cond);
   if (!condV)
     return nullptr;
 
-  // Convert condition to a bool by comparing non-equal to 0.0.
-  condV = CodeGenerator::builder->CreateFCmpONE(
-      condV, llvm::ConstantFP::get(*CodeGenerator::context, llvm::APFloat(0.0)), "ifcond");
-
   llvm::Function *function = CodeGenerator::builder->GetInsertBlock()->getParent();
 
   // Create blocks for the then and else cases.  Insert the 'then' block at the
@@ -155,8 +578,12 @@ llvm::Value *IfExpr::codegen() {
   llvm::Value *thenV = then->codegen();
   if (!thenV)
     return nullptr;
+  thenV = CodeGenerator::convert(thenV, then->type, type);
 
-  CodeGenerator::builder->CreateBr(mergeBB);
+  // An arm ending in a tail call doesn't reach the merge block
+  bool thenReturned = CodeGenerator::blockReturned();
+  if (!thenReturned)
+    CodeGenerator::builder->CreateBr(mergeBB);
   // Codegen of 'Then' can change the current block, update ThenBB for the PHI.
   thenBB = CodeGenerator::builder->GetInsertBlock();
 
@@ -167,121 +594,229 @@ llvm::Value *IfExpr::codegen() {
   llvm::Value *elseV = else_->codegen();
   if (!elseV)
     return nullptr;
+  elseV = CodeGenerator::convert(elseV, else_->type, type);
 
-  CodeGenerator::builder->CreateBr(mergeBB);
+  bool elseReturned = CodeGenerator::blockReturned();
+  if (!elseReturned)
+    CodeGenerator::builder->CreateBr(mergeBB);
   // Codegen of 'Else' can change the current block, update ElseBB for the PHI.
   elseBB = CodeGenerator::builder->GetInsertBlock();
 
+  // Both arms are tail calls: nothing follows, and the current block stays ended
+  if (thenReturned && elseReturned) {
+    delete mergeBB;
+    return elseV;
+  }
+
   // Emit merge block.
   function->insert(function->end(), mergeBB);
   CodeGenerator::builder->SetInsertPoint(mergeBB);
-  llvm::PHINode *PN = CodeGenerator::builder->CreatePHI(llvm::Type::getDoubleTy(*CodeGenerator::context), 2, "iftmp");
+  llvm::PHINode *PN = CodeGenerator::builder->CreatePHI(CodeGenerator::llvmType(type), 2, "iftmp");
 
-  PN->addIncoming(thenV, thenBB);
-  PN->addIncoming(elseV, elseBB);
+  if (!thenReturned)
+    PN->addIncoming(thenV, thenBB);
+  if (!elseReturned)
+    PN->addIncoming(elseV, elseBB);
   return PN;
 }
 
 llvm::Value *WhileExpr::codegen() {
   llvm::Function *function = CodeGenerator::builder->GetInsertBlock()->getParent();
-  std::cout << "bruh " << __LINE__ << std::endl;
 
-  llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(*CodeGenerator::context, "entrywhile", function);
-  llvm::BasicBlock *loopBB = llvm::BasicBlock::Create(*CodeGenerator::context, "loopwhile");
-  llvm::BasicBlock *endBB = llvm::BasicBlock::Create(*CodeGenerator::context, "endwhile");
-  std::cout << "bruh " << __LINE__ << std::endl;
+  llvm::BasicBlock *condBB = llvm::BasicBlock::Create(*CodeGenerator::context, "whilecond", function);
+  llvm::BasicBlock *loopBB = llvm::BasicBlock::Create(*CodeGenerator::context, "whilebody");
+  llvm::BasicBlock *endBB = llvm::BasicBlock::Create(*CodeGenerator::context, "whileend");
 
-  // Insert an explicit fall through from the current block to the entry
-  CodeGenerator::builder->CreateBr(loopBB);
-  std::cout << "bruh " << __LINE__ << std::endl;
+  // Insert an explicit fall through from the current block to the condition
+  CodeGenerator::builder->CreateBr(condBB);
 
-  // Loop entry
-  std::cout << "bruh " << __LINE__ << std::endl;
-  CodeGenerator::builder->SetInsertPoint(loopBB);
-  llvm::Value *condV = cond->codegen();
+  // The condition is checked before every iteration
+  CodeGenerator::builder->SetInsertPoint(condBB);
+  llvm::Value *condV = CodeGenerator::condition(*cond);
   if (!condV)
     return nullptr; // To-do: throw error
-  condV = CodeGenerator::builder->CreateFCmpONE(
-    condV, llvm::ConstantFP::get(*CodeGenerator::context, llvm::APFloat(0.0)), "loopcmp");
   CodeGenerator::builder->CreateCondBr(condV, loopBB, endBB);
-  entryBB = CodeGenerator::builder->GetInsertBlock();
-  std::cout << "bruh " << __LINE__ << std::endl;
 
-  // Loop body
+  // Loop body, whose value is discarded. Locals it assigns carry over to the
+  // next iteration through their stack slots.
   function->insert(function->end(), loopBB);
   CodeGenerator::builder->SetInsertPoint(loopBB);
-  llvm::Value* bodyVal = body->codegen();
-  std::cout << "bruh " << __LINE__ << std::endl;
-  if (!bodyVal) 
+  if (!body->codegen())
     return nullptr;
-  CodeGenerator::builder->CreateBr(entryBB);
-  std::cout << "bruh " << __LINE__ << std::endl;
+  CodeGenerator::builder->CreateBr(condBB);
 
   // Loop end
-  // function->getBasicBlockList().push_back(endBB);
-  function->insert(function->end(),endBB);
+  function->insert(function->end(), endBB);
   CodeGenerator::builder->SetInsertPoint(endBB);
-  std::cout << "bruh " << __LINE__ << std::endl;
 
   return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(*CodeGenerator::context));
 }
 
+llvm::Value *VarExpr::codegen() {
+  llvm::Function *function = CodeGenerator::builder->GetInsertBlock()->getParent();
+
+  if (array) {
+    llvm::IRBuilder<> &B = *CodeGenerator::builder;
+    if (!onHeap()) {
+      // Cleared each time the declaration is reached, like a scalar's initializer.
+      // Like on the heap, an empty or negative size still gets one element.
+      auto count = static_cast<std::uint64_t>(std::max(static_cast<NumberExpr &>(*init).value, 1.0));
+      llvm::AllocaInst *A = CodeGenerator::createEntryBlockAlloca(function, varType, DecafScanning::Interner::name(name), count);
+      B.CreateMemSet(A, B.getInt8(0), CodeGenerator::module_->getDataLayout().getTypeAllocSize(A->getAllocatedType()), A->getAlign());
+      CodeGenerator::namedValues[slot] = A;
+      return body->codegen();
+    }
+
+    llvm::Value *countV = init->codegen();
+    if (!countV)
+      return nullptr;
+    llvm::Value *A = CodeGenerator::allocateArray(CodeGenerator::convert(countV, init->type, ValueType::INT), varType, DecafScanning::Interner::name(name));
+    CodeGenerator::namedValues[slot] = A;
+    llvm::Value *bodyV = body->codegen();
+    if (!bodyV)
+      return nullptr;
+    CodeGenerator::freeArray(A);
+    return bodyV;
+  }
+
+  // The initializer is evaluated before the local is in scope
+  llvm::Value *initV = init->codegen();
+  if (!initV)
+    return nullptr;
+  llvm::AllocaInst *A = CodeGenerator::createEntryBlockAlloca(function, varType, DecafScanning::Interner::name(name));
+  CodeGenerator::builder->CreateStore(CodeGenerator::convert(initV, init->type, varType), A);
+  CodeGenerator::namedValues[slot] = A;
+
+  return body->codegen();
+}
+
 llvm::Function *Prototype::codegen() {
-  std::vector<llvm::Type*> doubles(args.size(),
-                             llvm::Type::getDoubleTy(*CodeGenerator::context));
+  std::vector<llvm::Type*> argTypesIR;
+  for (std::size_t i = 0; i < args.size(); i++)
+    argTypesIR.push_back(CodeGenerator::llvmType(argType(i)));
   llvm::FunctionType *FT =
-    llvm::FunctionType::get(llvm::Type::getDoubleTy(*CodeGenerator::context), doubles, false);
+    llvm::FunctionType::get(CodeGenerator::llvmType(returnType), argTypesIR, false);
 
   llvm::Function *F =
-    llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, CodeGenerator::module_.get());
+    llvm::Function::Create(FT, llvm::Function::ExternalLinkage, getName(), CodeGenerator::module_.get());
+  if (function >= CodeGenerator::moduleFunctions.size())
+    CodeGenerator::moduleFunctions.resize(function + 1);
+  CodeGenerator::moduleFunctions[function] = F;
+
+  CodeGenerator::addEffectAttributes(F, CodeGenerator::purity.effects(function));
 
   // Set names for all arguments.
   unsigned i = 0;
   for (auto &arg : F->args())
-    arg.setName(args[i++]);
+    arg.setName(DecafScanning::Interner::name(args[i++]));
 
   return F;
 }
 
 llvm::Function *Function::codegen() {
+  // Errors are left in the resolver's diagnostics for the caller to report
+  std::size_t errors = CodeGenerator::resolver.diagnostics().size();
+  CodeGenerator::resolver.resolve(*this);
+  if (CodeGenerator::resolver.diagnostics().size() != errors)
+    return nullptr;
+  std::size_t folded = DecafParsing::ConstantFolder().fold(*this);
+  DECAF_TRACE(CODEGEN, DecafLogger::Logger::trace(DecafLogger::TraceCategory::CODEGEN,
+    DecafLogger::stringFormat("Constant folding removed %zu nodes from %s", folded, std::string(proto->getName()).c_str())));
+  CodeGenerator::resolver.markTailCalls(*this);
+  const DecafParsing::FunctionEffects &effects = CodeGenerator::purity.analyze(*this, CodeGenerator::memoizePureFunctions || proto->memoize);
+
   // First, check for an existing function from a previous 'extern' declaration
   auto &P = *proto;
-  CodeGenerator::functionProtos[proto->getName()] = std::move(proto);
-  llvm::Function *theFunction = getFunction(P.getName());
+  if (P.function >= CodeGenerator::functionProtos.size())
+    CodeGenerator::functionProtos.resize(P.function + 1);
+  CodeGenerator::functionProtos[P.function] = proto;
+  llvm::Function *theFunction = getFunction(P.function);
 
   if (!theFunction) // To-do: Throw error
     return nullptr;
+  // The declaration may predate the analysis when a call came first
+  CodeGenerator::addEffectAttributes(theFunction, effects);
   
+  // Fast-math flags go on every floating-point instruction of the function, so
+  // they stay with it when it is inlined into strict code. They are what lets
+  // LLVM vectorize reductions and contract multiplies and adds into FMAs.
+  llvm::FastMathFlags FMF;
+  if (CodeGenerator::fastMath || P.fastMath)
+    FMF.setFast();
+  CodeGenerator::builder->setFastMathFlags(FMF);
+
   // Create a new basic block to start insertion into
   llvm::BasicBlock *BB = llvm::BasicBlock::Create(*CodeGenerator::context, "entry", theFunction);
   CodeGenerator::builder->SetInsertPoint(BB);
 
-  // Record the function arguments in the NamedValues map
-  CodeGenerator::namedValues.clear();
-  for (auto &arg : theFunction->args())
-    CodeGenerator::namedValues[std::string(arg.getName())] = &arg;
-
-  if (llvm::Value *retVal = body->codegen()) {
-    // Finish off the function
-    CodeGenerator::builder->CreateRet(retVal);
-
-    // Validate the generated code, checking for consistency
-    llvm::verifyFunction(*theFunction);
-
-    DecafLogger::Logger::logMessage(DecafLogger::LogType::DEBUG_INFO, "Unoptimized function");
-    theFunction->print(llvm::errs());
-    fprintf(stderr, "\n");
+  // Copy the arguments into stack slots so they can be assigned like locals,
+  // whose slots follow once their declarations are generated
+  CodeGenerator::namedValues.assign(slotCount, nullptr);
+  for (auto &arg : theFunction->args()) {
+    llvm::AllocaInst *A = CodeGenerator::createEntryBlockAlloca(theFunction, P.argType(arg.getArgNo()), arg.getName());
+    CodeGenerator::builder->CreateStore(&arg, A);
+    CodeGenerator::namedValues[arg.getArgNo()] = A;
+  }
 
-    DecafLogger::Logger::logMessage(DecafLogger::LogType::DEBUG_INFO, "Optimized function");
-    CodeGenerator::FPM->run(*theFunction, *CodeGenerator::FAM);
-    theFunction->print(llvm::errs());
-    fprintf(stderr, "\n");
+  // Self tail calls loop back to a header after storing the new arguments
+  CodeGenerator::currentFunction = P.function;
+  CodeGenerator::tailRecurseBlock = nullptr;
+  if (selfTailCalls) {
+    CodeGenerator::tailRecurseBlock = llvm::BasicBlock::Create(*CodeGenerator::context, "tailrecurse", theFunction);
+    CodeGenerator::builder->CreateBr(CodeGenerator::tailRecurseBlock);
+    CodeGenerator::builder->SetInsertPoint(CodeGenerator::tailRecurseBlock);
+  }
 
-    return theFunction;
+  if (llvm::Value *retVal = body->codegen()) {
+    // Finish off the function, unless it ended in tail calls
+    if (!CodeGenerator::blockReturned())
+      CodeGenerator::builder->CreateRet(CodeGenerator::convert(retVal, body->type, P.returnType));
+
+    // Validate the generated code, checking for consistency, unless compiling fast
+    const bool verify = CodeGenerator::optLevel != OptLevel::O0;
+    if (verify)
+      llvm::verifyFunction(*theFunction);
+
+    // Top-level expressions are never called, so each gets a definition of its own
+    if (P.name == DecafScanning::kAnonymousFunction)
+      CodeGenerator::moduleFunctions[P.function] = nullptr;
+
+    // With memoization the wrapper takes the function's place
+    std::vector<llvm::Function *> generated { theFunction };
+    if (effects.memoized) {
+      llvm::Function *wrapper = CodeGenerator::memoize(theFunction);
+      CodeGenerator::moduleFunctions[P.function] = wrapper;
+      if (verify)
+        llvm::verifyFunction(*wrapper);
+      generated.push_back(wrapper);
+    }
+
+    for (llvm::Function *F : generated) {
+      DECAF_TRACE(IR_BEFORE,
+        DecafLogger::Logger::trace(DecafLogger::TraceCategory::IR_BEFORE, "Unoptimized function");
+        F->print(llvm::errs());
+        llvm::errs() << '\n');
+
+      if (CodeGenerator::optLevel == OptLevel::O0 || CodeGenerator::wholeProgram)
+        continue;
+      CodeGenerator::FPM->run(*F, *CodeGenerator::FAM);
+
+      DECAF_TRACE(IR_AFTER,
+        DecafLogger::Logger::trace(DecafLogger::TraceCategory::IR_AFTER, "Optimized function");
+        F->print(llvm::errs());
+        llvm::errs() << '\n');
+    }
+
+    return generated.back();
   }
 
-  // Error reading body, remove function
-  theFunction->eraseFromParent();
+  // Error reading body, remove function. In whole-program mode callers
+  // generated earlier may already use it, so it stays as a declaration.
+  theFunction->deleteBody();
+  if (theFunction->use_empty()) {
+    theFunction->eraseFromParent();
+    CodeGenerator::moduleFunctions[P.function] = nullptr;
+  }
   return nullptr; // To-do: Throw error
 }
 
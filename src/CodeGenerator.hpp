@@ -2,19 +2,60 @@
 #define CODEGEN_H
 
 #include "AST.hpp"
+#include "Purity.hpp"
+#include "Resolver.hpp"
 
-#include <map>
-#include <string>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 namespace DecafCodeGen {
 
+// How hard to optimize, as with -O0 to -O3 and -Os. O0 compiles fastest: no
+// IR passes, no verifier and fast instruction selection in the JIT.
+enum class OptLevel : std::uint8_t {
+  O0,
+  O1,
+  O2,
+  O3,
+  Os,
+};
+
 class CodeGenerator {
 public:
   static std::unique_ptr<llvm::LLVMContext> context;
   static std::unique_ptr<llvm::IRBuilder<>> builder;
   static std::unique_ptr<llvm::Module> module_;
-  static std::map<std::string, llvm::Value*> namedValues;
-  static std::map<std::string, std::unique_ptr<DecafParsing::AST::Prototype>> functionProtos;
+  // Names are resolved to indices before code generation, so all symbol
+  // tables are vectors: variables by slot, the rest by function ID
+  static DecafParsing::Resolver resolver;
+  static DecafParsing::PurityAnalysis purity;
+  // Wrap every pure function with arguments in a memo table keyed by them, as
+  // if each were declared `def memo`. Set it before generating code.
+  static bool memoizePureFunctions;
+  // Global fast-math: all floating-point math may be reassociated and
+  // contracted, and the JIT fuses multiplies and adds. There is no command-line
+  // flag; this static is the switch. Functions declared `def fast` opt in one
+  // at a time. Read by JIT::initJIT(), so set it first.
+  static bool fastMath;
+  // Read by JIT::initJIT() and initializeModuleAndPassManager(), so set it first
+  static OptLevel optLevel;
+  // Parse a flag such as "-O2"; nullopt if it isn't one
+  static std::optional<OptLevel> parseOptLevel(std::string_view flag);
+  // Addresses of variables. Arguments and locals live in stack slots in the
+  // entry block, which SROA and mem2reg promote to registers, placing the PHIs
+  // loops need. Arrays are their first element.
+  static std::vector<llvm::Value*> namedValues;
+  // Prototypes point into the arena of the parser that produced them, which
+  // must outlive code generation or a reset()
+  static std::vector<DecafParsing::AST::Prototype*> functionProtos;
+  // Declarations already emitted into the current module
+  static std::vector<llvm::Function*> moduleFunctions;
+
+  // Function being generated, and the loop header its self tail calls jump
+  // to (null if it has none) after storing the new arguments
+  static std::uint32_t currentFunction;
+  static llvm::BasicBlock *tailRecurseBlock;
 
   static std::unique_ptr<llvm::FunctionPassManager> FPM;
   static std::unique_ptr<llvm::LoopAnalysisManager> LAM;
@@ -24,9 +65,51 @@ public:
   static std::unique_ptr<llvm::PassInstrumentationCallbacks> PIC;
   static std::unique_ptr<llvm::StandardInstrumentations> SI;
 
-  static llvm::PassBuilder PB;
-  
+  static std::unique_ptr<llvm::PassBuilder> PB;
+
+  // Open a new module with pass and analysis managers of its own, so cached
+  // analyses never outlive the functions they describe
   static void initializeModuleAndPassManager();
+  // Forget every function and diagnostic of the previous program, whose
+  // prototypes may be gone with its parser. Call before generating code from a
+  // new parser, along with a new JIT, since function IDs start over.
+  static void reset();
+  // Vectorize and unroll loops after the function simplification pipeline
+  static void addLoopOptimizationPasses(llvm::FunctionPassManager &FPM);
+
+  // Set while generating a whole program. optimizeProgram() runs the module
+  // pipeline, which simplifies and vectorizes every function itself, so the
+  // per-function passes are skipped. Cleared for each new module.
+  static bool wholeProgram;
+  // Whole-program mode: declare every function before generating any, so
+  // definitions can call functions defined after them
+  static void declare(DecafParsing::AST::Prototype &proto);
+  // Optimize the module across functions once all of it is generated. Only the
+  // entry points are called from outside; everything else becomes internal,
+  // uses the fast calling convention and may be inlined or removed.
+  static void optimizeProgram(const std::vector<llvm::Function*> &entryPoints);
+
+  // Lowering of value types: double, i64 and i1
+  static llvm::Type *llvmType(DecafParsing::AST::ValueType type);
+  static llvm::AllocaInst *createEntryBlockAlloca(llvm::Function *function, DecafParsing::AST::ValueType type, llvm::StringRef name,
+                                                  std::uint64_t count = 1);
+  // Zeroed storage for count elements of the given type from the C heap, to be
+  // released with freeArray()
+  static llvm::Value *allocateArray(llvm::Value *count, DecafParsing::AST::ValueType type, llvm::StringRef name);
+  static void freeArray(llvm::Value *array);
+  // Address of the element an index expression refers to, null if it isn't an array
+  static llvm::Value *elementPointer(DecafParsing::AST::IndexExpr &expr);
+  static llvm::Value *convert(llvm::Value *value, DecafParsing::AST::ValueType from, DecafParsing::AST::ValueType to);
+  // Generate expr as an i1 for a branch
+  static llvm::Value *condition(DecafParsing::AST::Expr &expr);
+  static void addEffectAttributes(llvm::Function *function, const DecafParsing::FunctionEffects &effects);
+
+  // Replace the definition of a pure function by a wrapper that looks its
+  // arguments up in a memo table and only calls it on a miss. Returns the wrapper.
+  static llvm::Function *memoize(llvm::Function *function);
+
+  // Tail calls return or jump themselves, ending the current block
+  static bool blockReturned() { return builder->GetInsertBlock()->getTerminator() != nullptr; }
 };
 
 }
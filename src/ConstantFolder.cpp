@@ -0,0 +1,214 @@
+#include "ConstantFolder.hpp"
+
+#include <cmath>
+
+namespace DecafParsing {
+
+namespace {
+
+using DecafScanning::TokenType;
+
+AST::NumberExpr* asNumber(AST::Expr* expr) {
+  return expr->kind == AST::ExprKind::NUMBER ? static_cast<AST::NumberExpr*>(expr) : nullptr;
+}
+
+// Conditions are true when they compare ordered and unequal to 0.0, as in codegen
+bool isTrue(double value) {
+  return value < 0.0 || value > 0.0;
+}
+
+// Integer arithmetic is folded in doubles, which is exact below 2^53: past it
+// not every integer has a double, so a result of 2^53 may already be rounded
+constexpr double kMaxExactInteger = 0x1p53;
+
+}
+
+std::size_t ConstantFolder::fold(AST::Function& function) {
+  m_removed = 0;
+  function.body = foldExpr(function.body);
+  return m_removed;
+}
+
+// Fold the children first so constants propagate upwards, then the node itself.
+// Returns the node replacing expr.
+AST::Expr* ConstantFolder::foldExpr(AST::Expr* expr) {
+  switch (expr->kind) {
+    case AST::ExprKind::NUMBER:
+    case AST::ExprKind::VARIABLE:
+      return expr;
+
+    case AST::ExprKind::INDEX: {
+      auto& index = static_cast<AST::IndexExpr&>(*expr);
+      index.index = foldExpr(index.index);
+      return expr;
+    }
+
+    case AST::ExprKind::BINARY: {
+      auto& binary = static_cast<AST::BinaryExpr&>(*expr);
+      binary.LHS = foldExpr(binary.LHS);
+      binary.RHS = foldExpr(binary.RHS);
+      return foldBinary(binary);
+    }
+
+    case AST::ExprKind::CALL:
+      for (AST::Expr*& arg : static_cast<AST::CallExpr&>(*expr).args)
+        arg = foldExpr(arg);
+      return expr;
+
+    case AST::ExprKind::IF: {
+      auto& ifExpr = static_cast<AST::IfExpr&>(*expr);
+      ifExpr.cond = foldExpr(ifExpr.cond);
+      ifExpr.then = foldExpr(ifExpr.then);
+      ifExpr.else_ = foldExpr(ifExpr.else_);
+      AST::NumberExpr* cond = asNumber(ifExpr.cond);
+      if (!cond)
+        return expr;
+
+      AST::Expr* taken = isTrue(cond->value) ? ifExpr.then : ifExpr.else_;
+      if (!retype(*taken, ifExpr.type))
+        return expr;
+      discard(isTrue(cond->value) ? *ifExpr.else_ : *ifExpr.then);
+      m_removed += 2; // The if and its condition
+      return taken;
+    }
+
+    case AST::ExprKind::WHILE: {
+      auto& whileExpr = static_cast<AST::WhileExpr&>(*expr);
+      whileExpr.cond = foldExpr(whileExpr.cond);
+      whileExpr.body = foldExpr(whileExpr.body);
+      AST::NumberExpr* cond = asNumber(whileExpr.cond);
+      if (!cond || isTrue(cond->value))
+        return expr;
+
+      // The loop never runs and evaluates to 0.0
+      cond->value = 0.0;
+      cond->type = whileExpr.type;
+      discard(*whileExpr.body);
+      m_removed++;
+      return cond;
+    }
+
+    case AST::ExprKind::VAR: {
+      auto& var = static_cast<AST::VarExpr&>(*expr);
+      var.init = foldExpr(var.init);
+      var.body = foldExpr(var.body);
+      return expr;
+    }
+  }
+  llvm_unreachable("Unknown expression kind");
+}
+
+AST::Expr* ConstantFolder::foldBinary(AST::BinaryExpr& binary) {
+  AST::NumberExpr* lhs = asNumber(binary.LHS);
+  AST::NumberExpr* rhs = asNumber(binary.RHS);
+
+  // Literals have no effects, so a sequence can drop one on its left
+  if (binary.op.type == TokenType::SEMICOLON) {
+    if (lhs) {
+      m_removed += 2;
+      return binary.RHS;
+    }
+    return &binary;
+  }
+
+  if (lhs && rhs) {
+    double l = lhs->value, r = rhs->value;
+    switch (binary.op.type) {
+      case TokenType::PLUS:
+        lhs->value = l + r;
+        break;
+      case TokenType::MINUS:
+        lhs->value = l - r;
+        break;
+      case TokenType::TIMES:
+        lhs->value = l * r;
+        break;
+      case TokenType::DIVIDE: // Integer division truncates, which the doubles don't
+        if (binary.type != AST::ValueType::DOUBLE)
+          return &binary;
+        lhs->value = l / r;
+        break;
+      // Comparisons are unordered, so they hold when either side is NaN
+      case TokenType::LESS_THAN:
+        lhs->value = !(l >= r) ? 1.0 : 0.0;
+        break;
+      case TokenType::GREATER_THAN:
+        lhs->value = !(l <= r) ? 1.0 : 0.0;
+        break;
+      case TokenType::LESS_THAN_EQUAL:
+        lhs->value = !(l > r) ? 1.0 : 0.0;
+        break;
+      case TokenType::GREATER_THAN_EQUAL:
+        lhs->value = !(l < r) ? 1.0 : 0.0;
+        break;
+      case TokenType::EQUAL_EQUAL:
+        lhs->value = !(l < r || l > r) ? 1.0 : 0.0;
+        break;
+      default: // Assignment needs a variable on its left
+        return &binary;
+    }
+    // Leave integer results the doubles can't hold exactly to wrap at run time
+    if (binary.type == AST::ValueType::INT && std::abs(lhs->value) >= kMaxExactInteger) {
+      lhs->value = l;
+      return &binary;
+    }
+    lhs->type = binary.type;
+    m_removed += 2; // The operation and its right operand
+    return lhs;
+  }
+
+  // Identities that hold for every value, including NaN, infinities and -0.0.
+  // x + 0.0 is not one of them: it turns -0.0 into 0.0. They only apply when
+  // x already has the type of the result, since otherwise there is a conversion.
+  switch (binary.op.type) {
+    case TokenType::TIMES:
+      if (rhs && rhs->value == 1.0 && binary.LHS->type == binary.type) {
+        m_removed += 2;
+        return binary.LHS;
+      }
+      if (lhs && lhs->value == 1.0 && binary.RHS->type == binary.type) {
+        m_removed += 2;
+        return binary.RHS;
+      }
+      break;
+    case TokenType::MINUS:
+      if (rhs && rhs->value == 0.0 && !std::signbit(rhs->value) && binary.LHS->type == binary.type) {
+        m_removed += 2;
+        return binary.LHS;
+      }
+      break;
+    default:
+      break;
+  }
+  return &binary;
+}
+
+bool ConstantFolder::retype(AST::Expr& expr, AST::ValueType type) {
+  if (expr.type == type)
+    return true;
+  AST::NumberExpr* number = asNumber(&expr);
+  if (!number)
+    return false;
+
+  switch (type) {
+    case AST::ValueType::DOUBLE: // Ints are exact and bools are 0 or 1
+      break;
+    case AST::ValueType::INT:
+      // Only ever widening, as commonType() never narrows a branch to an int
+      if (number->type == AST::ValueType::DOUBLE)
+        return false;
+      break;
+    case AST::ValueType::BOOL:
+      number->value = isTrue(number->value) ? 1.0 : 0.0;
+      break;
+  }
+  number->type = type;
+  return true;
+}
+
+void ConstantFolder::discard(AST::Expr& expr) {
+  m_removed++;
+  AST::forEachChild(expr, [this](AST::Expr& child) { discard(child); });
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef CONSTANT_FOLDER_H
+#define CONSTANT_FOLDER_H
+
+#include "AST.hpp"
+
+#include <cstddef>
+
+namespace DecafParsing {
+
+// Simplifies a function's AST before code generation: arithmetic and
+// comparisons on literals are evaluated, multiplying by one and subtracting
+// zero are dropped, ifs with a constant condition are replaced by the branch
+// taken, whiles whose condition is constantly false are removed and so are
+// literals whose value a sequence discards. Every
+// rewrite gives exactly the value the unfolded code would compute, with the
+// same type, so the function must have been resolved first.
+//
+// Nodes are rewritten in place and reuse existing literals, so folding never
+// allocates.
+class ConstantFolder {
+public:
+  // Fold the body of function and return the number of nodes removed
+  std::size_t fold(AST::Function& function);
+
+private:
+  std::size_t m_removed = 0;
+
+  AST::Expr* foldExpr(AST::Expr* expr);
+  AST::Expr* foldBinary(AST::BinaryExpr& binary);
+  void discard(AST::Expr& expr); // Count expr and its subtree as removed
+  // Give expr the given type if that needs no code, which is possible for literals
+  static bool retype(AST::Expr& expr, AST::ValueType type);
+};
+
+}
+
+#endif // CONSTANT_FOLDER_H
@@ -0,0 +1,32 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+namespace DecafLogger {
+
+enum class LogType {
+  DEBUG_INFO,
+  ERROR,
+  WARNING
+};
+
+// An error or warning at a source position, collected to be reported after a whole pass
+struct Diagnostic {
+  LogType type;
+  std::string message;
+  std::size_t position;
+};
+
+// Thrown for errors at a known source position
+class CompileError : public std::runtime_error {
+public:
+  CompileError(const std::string& msg, std::size_t position) : std::runtime_error(msg), position(position) {}
+  std::size_t position;
+};
+
+}
+
+#endif // DIAGNOSTIC_H
@@ -0,0 +1,21 @@
+#include "Interner.hpp"
+
+namespace DecafScanning {
+
+DecafMemory::Arena Interner::arena;
+std::unordered_map<std::string_view, Symbol> Interner::ids { { "__anon_expr", kAnonymousFunction } };
+std::vector<std::string_view> Interner::names { "__anon_expr" };
+
+Symbol Interner::intern(std::string_view name) {
+  auto found = ids.find(name);
+  if (found != ids.end())
+    return found->second;
+
+  std::string_view copy = arena.copyString(name);
+  Symbol symbol = static_cast<Symbol>(names.size());
+  names.push_back(copy);
+  ids.emplace(copy, symbol);
+  return symbol;
+}
+
+}
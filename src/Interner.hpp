@@ -0,0 +1,39 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include "Arena.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace DecafScanning {
+
+// Dense ID of an interned identifier. Equal names always get the same ID, so
+// later phases compare and index by symbol instead of by string.
+using Symbol = std::uint32_t;
+
+// Name of the synthesized function wrapping top-level expressions, interned
+// ahead of everything else
+constexpr Symbol kAnonymousFunction = 0;
+
+// Process-wide identifier table shared by every lexer, so symbols stay
+// comparable across sources compiled into the same program. Names are copied
+// into an arena and never move. Not thread-safe: intern from a single thread.
+class Interner {
+public:
+  static Symbol intern(std::string_view name);
+  static std::string_view name(Symbol symbol) { return names[symbol]; }
+  // Number of symbols handed out so far; every symbol is below it
+  static std::size_t count() { return names.size(); }
+
+private:
+  static DecafMemory::Arena arena;
+  static std::unordered_map<std::string_view, Symbol> ids;
+  static std::vector<std::string_view> names;
+};
+
+}
+
+#endif // INTERNER_H
@@ -3,7 +3,23 @@
 
 using namespace DecafJIT;
 
+namespace {
+
+llvm::CodeGenOpt::Level codeGenLevel(DecafCodeGen::OptLevel level) {
+  switch (level) {
+    case DecafCodeGen::OptLevel::O0: return llvm::CodeGenOpt::None;
+    case DecafCodeGen::OptLevel::O1: return llvm::CodeGenOpt::Less;
+    case DecafCodeGen::OptLevel::O2: return llvm::CodeGenOpt::Default;
+    case DecafCodeGen::OptLevel::O3: return llvm::CodeGenOpt::Aggressive;
+    case DecafCodeGen::OptLevel::Os: return llvm::CodeGenOpt::Default; // Size is the IR pipeline's concern
+  }
+  llvm_unreachable("Unknown optimization level");
+}
+
+}
+
 llvm::ExitOnError JIT::exitOnError;
+bool JIT::targetHostCPU = true;
 std::unique_ptr<llvm::orc::KaleidoscopeJIT> JIT::JIT_;
 
 void JIT::initJIT() {
@@ -11,27 +27,34 @@ void JIT::initJIT() {
   llvm::InitializeNativeTargetAsmPrinter();
   llvm::InitializeNativeTargetAsmParser();
 
-  JIT::JIT_ = exitOnError(llvm::orc::KaleidoscopeJIT::Create());
+  JIT::JIT_ = exitOnError(llvm::orc::KaleidoscopeJIT::Create(
+      codeGenLevel(DecafCodeGen::CodeGenerator::optLevel),
+      DecafCodeGen::CodeGenerator::fastMath ? llvm::FPOpFusion::Fast : llvm::FPOpFusion::Standard,
+      JIT::targetHostCPU));
+  DECAF_TRACE(JIT,
+    const llvm::TargetMachine &TM = JIT::JIT_->getTargetMachine();
+    DecafLogger::Logger::trace(DecafLogger::TraceCategory::JIT, DecafLogger::stringFormat("Generating code for %s, CPU %s, features %s",
+      TM.getTargetTriple().str().c_str(), TM.getTargetCPU().str().c_str(), TM.getTargetFeatureString().str().c_str())));
 }
 
 void DecafJIT::handleFuncDefinition(DecafParsing::Parser* parser) {
   if (auto fnAST = parser->parseFuncDefinition()) {
     if (auto *fnIR = fnAST->codegen()) {
-      fprintf(stderr, "Read function definition:");
-      fnIR->print(llvm::errs());
-      fprintf(stderr, "\n");
+      DECAF_TRACE(JIT,
+        DecafLogger::Logger::trace(DecafLogger::TraceCategory::JIT, "Read function definition:");
+        fnIR->print(llvm::errs());
+        llvm::errs() << '\n');
       JIT::exitOnError(JIT::JIT_->addModule(
           llvm::orc::ThreadSafeModule(std::move(DecafCodeGen::CodeGenerator::module_), std::move(DecafCodeGen::CodeGenerator::context))));
       DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
     }
   } else {
-    // Skip token for error recovery.
-    parser->consume();
+    parser->synchronize(); // Skip to the next unit; the error is in parser->diagnostics()
   }
 }
 
 double DecafJIT::handleTopLevelStatement(DecafParsing::Parser* parser) {
-  DecafLogger::Logger::displayToken(parser->peek().value());
+  DECAF_TRACE(JIT, DecafLogger::Logger::displayToken(parser->peek(), parser->source()));
   if (auto fnAST = parser->parseTopLevelExpr()) {
     if (fnAST->codegen()) {
       auto RT = DecafJIT::JIT::JIT_->getMainJITDylib().createResourceTracker();
@@ -51,8 +74,61 @@ double DecafJIT::handleTopLevelStatement(DecafParsing::Parser* parser) {
       return result;
     }
   } else {
-    // Skip token for error recovery
-    parser->consume();
-    return -1.0;
+    parser->synchronize(); // Skip to the next unit; the error is in parser->diagnostics()
+  }
+  return -1.0;
+}
+
+std::vector<double> DecafJIT::handleProgram(DecafParsing::Parser* parser) {
+  std::vector<DecafParsing::AST::Function*> units = parser->parseProgram();
+
+  // The module pipeline in optimizeProgram() does the per-function work too
+  DecafCodeGen::CodeGenerator::wholeProgram = true;
+
+  // Definitions are generated first and may call each other in any order.
+  // Top-level statements follow and are the only entry points into the module.
+  for (DecafParsing::AST::Function* unit : units) {
+    if (unit->proto->name != DecafScanning::kAnonymousFunction)
+      DecafCodeGen::CodeGenerator::declare(*unit->proto);
+  }
+  bool failed = false;
+  for (DecafParsing::AST::Function* unit : units) {
+    if (unit->proto->name != DecafScanning::kAnonymousFunction)
+      failed |= !unit->codegen();
+  }
+  std::vector<llvm::Function*> entryPoints;
+  for (DecafParsing::AST::Function* unit : units) {
+    if (unit->proto->name == DecafScanning::kAnonymousFunction) {
+      llvm::Function* fnIR = unit->codegen();
+      failed |= !fnIR;
+      entryPoints.push_back(fnIR);
+    }
+  }
+
+  // A function that wasn't generated is only declared, so its callers can't
+  // run, and a missing statement would shift the results of the others. The
+  // errors are in the resolver's diagnostics.
+  if (failed) {
+    DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
+    return {};
+  }
+
+  DecafCodeGen::CodeGenerator::optimizeProgram(entryPoints);
+  std::vector<std::string> entryNames;
+  for (llvm::Function* entryPoint : entryPoints)
+    entryNames.push_back(entryPoint->getName().str());
+
+  auto RT = DecafJIT::JIT::JIT_->getMainJITDylib().createResourceTracker();
+  auto TSM = llvm::orc::ThreadSafeModule(std::move(DecafCodeGen::CodeGenerator::module_), std::move(DecafCodeGen::CodeGenerator::context));
+  DecafJIT::JIT::exitOnError(DecafJIT::JIT::JIT_->addModule(std::move(TSM), RT));
+  DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
+
+  std::vector<double> results;
+  for (const std::string& name : entryNames) {
+    auto exprSymbol = DecafJIT::JIT::exitOnError(DecafJIT::JIT::JIT_->lookup(name));
+    double (*FP)() = (double (*)())(intptr_t)exprSymbol.getAddress();
+    results.push_back(FP());
   }
+  DecafJIT::JIT::exitOnError(RT->remove());
+  return results;
 }
@@ -11,11 +11,22 @@ class JIT {
 public:
   static std::unique_ptr<llvm::orc::KaleidoscopeJIT> JIT_;  
   static llvm::ExitOnError exitOnError;
+  // Generate code for the host CPU and all its features. Off for output that
+  // is reproducible across machines and runs on any CPU of the target triple.
+  // Read by initJIT(), so set it first.
+  static bool targetHostCPU;
   static void initJIT();
 };
 
 void handleFuncDefinition(DecafParsing::Parser* parser);
 double handleTopLevelStatement(DecafParsing::Parser* parser);
+// Whole-program mode: compile all remaining definitions and top-level
+// statements into one module, optimize it across functions and add it to the
+// JIT once. Returns the values of the top-level statements in source order.
+// The module's functions are internal to it, so it is removed from the JIT
+// again once the statements have run. Nothing runs and the result is empty if
+// any unit fails to generate; the errors are in CodeGenerator::resolver.diagnostics().
+std::vector<double> handleProgram(DecafParsing::Parser* parser);
 
 }
 
@@ -25,6 +25,8 @@
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
 #include <memory>
 
 namespace llvm {
@@ -42,15 +44,19 @@ private:
 
   JITDylib &MainJD;
 
+  // Configured like the one the compile layer uses; for target-aware IR passes
+  std::unique_ptr<TargetMachine> TM;
+
 public:
   KaleidoscopeJIT(std::unique_ptr<ExecutionSession> ES,
-                  JITTargetMachineBuilder JTMB, DataLayout DL)
+                  JITTargetMachineBuilder JTMB, DataLayout DL,
+                  std::unique_ptr<TargetMachine> TM)
       : ES(std::move(ES)), DL(std::move(DL)), Mangle(*this->ES, this->DL),
         ObjectLayer(*this->ES,
                     []() { return std::make_unique<SectionMemoryManager>(); }),
         CompileLayer(*this->ES, ObjectLayer,
                      std::make_unique<ConcurrentIRCompiler>(std::move(JTMB))),
-        MainJD(this->ES->createBareJITDylib("<main>")) {
+        MainJD(this->ES->createBareJITDylib("<main>")), TM(std::move(TM)) {
     MainJD.addGenerator(
         cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(
             DL.getGlobalPrefix())));
@@ -65,28 +71,51 @@ public:
       ES->reportError(std::move(Err));
   }
 
-  static Expected<std::unique_ptr<KaleidoscopeJIT>> Create() {
+  static Expected<std::unique_ptr<KaleidoscopeJIT>>
+  Create(CodeGenOpt::Level OptLevel = CodeGenOpt::Default,
+         FPOpFusion::FPOpFusionMode FPFusion = FPOpFusion::Standard,
+         bool TargetHostCPU = true) {
     auto EPC = SelfExecutorProcessControl::Create();
     if (!EPC)
       return EPC.takeError();
 
     auto ES = std::make_unique<ExecutionSession>(std::move(*EPC));
 
+    // Generic code for the triple only uses its baseline features. The
+    // host's CPU name and features enable e.g. AVX2, AVX-512 and FMA.
     JITTargetMachineBuilder JTMB(
         ES->getExecutorProcessControl().getTargetTriple());
+    if (TargetHostCPU) {
+      auto HostJTMB = JITTargetMachineBuilder::detectHost();
+      if (!HostJTMB)
+        return HostJTMB.takeError();
+      JTMB = std::move(*HostJTMB);
+    }
+    JTMB.setCodeGenOptLevel(OptLevel);
+    // Selecting instructions quickly matters more than their quality at -O0
+    if (OptLevel == CodeGenOpt::None)
+      JTMB.getOptions().EnableFastISel = true;
+    // Instructions with the contract flag are fused either way
+    JTMB.getOptions().AllowFPOpFusion = FPFusion;
 
     auto DL = JTMB.getDefaultDataLayoutForTarget();
     if (!DL)
       return DL.takeError();
 
+    auto TM = JTMB.createTargetMachine();
+    if (!TM)
+      return TM.takeError();
+
     return std::make_unique<KaleidoscopeJIT>(std::move(ES), std::move(JTMB),
-                                             std::move(*DL));
+                                             std::move(*DL), std::move(*TM));
   }
 
   const DataLayout &getDataLayout() const { return DL; }
 
   JITDylib &getMainJITDylib() { return MainJD; }
 
+  TargetMachine &getTargetMachine() { return *TM; }
+
   Error addModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
     if (!RT)
       RT = MainJD.getDefaultResourceTracker();
@@ -1,182 +1,478 @@
 #include "Lexer.hpp"
 #include "Logger.hpp"
+#include "ScanKernels.hpp"
+#include "ThreadPool.hpp"
+
+#include <charconv>
+#include <cctype>
 
 namespace DecafScanning {
 
-// Constructor to initialize the lexer with the source string
-Lexer::Lexer(std::string src) : m_src(std::move(src)) {}
+namespace {
 
-// Tokenize the source string into a vector of tokens
-std::vector<Token> Lexer::tokenize() {
-  std::vector<Token> tokens; // Vector to store the tokens
-  std::string buffer;        // Buffer to accumulate characters for multi-character tokens
+// Character class of every byte, used to pick the scanning state from the start state
+constexpr std::array<CharClass, 256> kCharClass = [] {
+  std::array<CharClass, 256> table {};
+  table.fill(CharClass::INVALID);
+  for (unsigned char c : std::string_view(" \t\n\r\v\f"))
+    table[c] = CharClass::WHITESPACE;
+  for (int c = 'a'; c <= 'z'; c++)
+    table[c] = CharClass::IDENTIFIER_START;
+  for (int c = 'A'; c <= 'Z'; c++)
+    table[c] = CharClass::IDENTIFIER_START;
+  table['_'] = CharClass::IDENTIFIER_START;
+  for (int c = '0'; c <= '9'; c++)
+    table[c] = CharClass::DIGIT;
+  table['#'] = CharClass::COMMENT;
+  for (unsigned char c : std::string_view("(){}[]+-*/,;"))
+    table[c] = CharClass::PUNCTUATION;
+  for (unsigned char c : std::string_view("=<>"))
+    table[c] = CharClass::OPERATOR;
+  return table;
+}();
 
-  // Loop through the source string until all characters are processed
-  while (peek().has_value()) {
-    // If the current character is a letter or underscore, it might be an identifier or keyword
-    if (std::isalpha(peek().value()) || peek().value() == '_') {
-      buffer.push_back(consume()); // Add the character to the buffer
+// Token produced by a punctuation or operator character on its own
+constexpr std::array<TokenType, 256> kSingleCharToken = [] {
+  std::array<TokenType, 256> table {};
+  table['('] = TokenType::OPEN_PAREN;
+  table[')'] = TokenType::CLOSE_PAREN;
+  table['{'] = TokenType::OPEN_CURLY;
+  table['}'] = TokenType::CLOSE_CURLY;
+  table['['] = TokenType::OPEN_BRACKET;
+  table[']'] = TokenType::CLOSE_BRACKET;
+  table['+'] = TokenType::PLUS;
+  table['-'] = TokenType::MINUS;
+  table['*'] = TokenType::TIMES;
+  table['/'] = TokenType::DIVIDE;
+  table[','] = TokenType::COMMA;
+  table[';'] = TokenType::SEMICOLON;
+  table['='] = TokenType::EQUAL;
+  table['<'] = TokenType::LESS_THAN;
+  table['>'] = TokenType::GREATER_THAN;
+  return table;
+}();
 
-      // Continue adding characters to the buffer as long as they are alphanumeric or underscores
-      while (peek().has_value() && (std::isalnum(peek().value()) || peek().value() == '_')) {
-        buffer.push_back(consume());
-      }
+// Token produced by an operator character followed by '='
+constexpr std::array<TokenType, 256> kOperatorEqualToken = [] {
+  std::array<TokenType, 256> table {};
+  table['='] = TokenType::EQUAL_EQUAL;
+  table['<'] = TokenType::LESS_THAN_EQUAL;
+  table['>'] = TokenType::GREATER_THAN_EQUAL;
+  return table;
+}();
 
-      std::vector<std::string> reserved = {
-        "for",
-        "callout",
-        "class",
-        "interface",
-        "extends",
-        "implements",
-        "new",
-        "this",
-        "string",
-        "float",
-        "double",
-        "null"
-      };
-      
-      // Check for specific keywords and add the corresponding token
-      std::size_t startPosition = m_index - buffer.length(); // Get start of identifier or keyword
-      if (buffer == "def") {
-        tokens.push_back({ .type = TokenType::DEF, .position = startPosition, .length = buffer.length() });
-      } else if (buffer == "if") {
-        tokens.push_back({ .type = TokenType::IF, .position = startPosition, .length = buffer.length() });
-      } else if (buffer == "else") {
-        tokens.push_back({ .type = TokenType::ELSE, .position = startPosition, .length = buffer.length() });
-      } else if (buffer == "while") {
-        tokens.push_back({ .type = TokenType::WHILE, .position = startPosition, .length = buffer.length() });
-      } else if (buffer == "return") {
-        tokens.push_back({ .type = TokenType::RETURN, .position = startPosition, .length = buffer.length() });
-      } else {
-        if (std::find(reserved.begin(), reserved.end(), buffer) != reserved.end()) { // Warn  about reserved keywords being used as identifiers
-          DecafLogger::Logger::logMessage(DecafLogger::LogType::WARNING, DecafLogger::stringFormat("Reserved keyword '%s' used as identifier! This can cause issues in later versions of the compiler.", buffer.c_str()), startPosition);
-        }
-
-        // If the buffer does not match any keywords, treat it as an identifier
-        tokens.push_back({ .type = TokenType::IDENTIFIER, .value = buffer });
-      }
+// Keywords and reserved words. Reserved words have no token type of their own
+// and are lexed as identifiers (with a warning).
+constexpr std::array<Keyword, 24> kKeywords = {{
+  { "def",        TokenType::DEF,        false },
+  { "if",         TokenType::IF,         false },
+  { "else",       TokenType::ELSE,       false },
+  { "while",      TokenType::WHILE,      false },
+  { "return",     TokenType::RETURN,     false },
+  { "int",        TokenType::INT,        false },
+  { "bool",       TokenType::BOOL,       false },
+  { "true",       TokenType::TRUE,       false },
+  { "false",      TokenType::FALSE,      false },
+  { "var",        TokenType::VAR,        false },
+  { "fast",       TokenType::FAST,       false },
+  { "memo",       TokenType::MEMO,       false },
+  { "for",        TokenType::IDENTIFIER, true },
+  { "callout",    TokenType::IDENTIFIER, true },
+  { "class",      TokenType::IDENTIFIER, true },
+  { "interface",  TokenType::IDENTIFIER, true },
+  { "extends",    TokenType::IDENTIFIER, true },
+  { "implements", TokenType::IDENTIFIER, true },
+  { "new",        TokenType::IDENTIFIER, true },
+  { "this",       TokenType::IDENTIFIER, true },
+  { "string",     TokenType::IDENTIFIER, true },
+  { "float",      TokenType::IDENTIFIER, true },
+  { "double",     TokenType::IDENTIFIER, true },
+  { "null",       TokenType::IDENTIFIER, true }
+}};
 
-      buffer.clear(); // Clear the buffer for the next token
-    }
+constexpr std::size_t kKeywordTableBits = 6;
+constexpr std::size_t kKeywordTableSize = std::size_t(1) << kKeywordTableBits;
 
-    // If the current character is a digit, it might be a number
-    else if (std::isdigit(peek().value())) {
-      buffer.push_back(consume()); // Add the digit to the buffer
+// Multiplicative hash over the length, first and last character of a word.
+// Cheap enough to run on every identifier; the seed is chosen at compile time
+// so that no two keywords collide.
+constexpr std::size_t keywordHash(std::string_view word, std::uint32_t seed) {
+  std::uint32_t key = (static_cast<std::uint32_t>(static_cast<unsigned char>(word.front())) << 16)
+                    ^ (static_cast<std::uint32_t>(static_cast<unsigned char>(word.back())) << 8)
+                    ^ static_cast<std::uint32_t>(word.size());
+  return (key * seed) >> (32 - kKeywordTableBits);
+}
 
-      // Continue adding digits to the buffer
-      while (peek().has_value() && std::isdigit(peek().value())) {
-        buffer.push_back(consume());
+constexpr std::uint32_t findKeywordSeed() {
+  for (std::uint32_t seed = 0x9E3779B1u; seed < 0x9E3779B1u + 100000; seed += 2) {
+    std::array<bool, kKeywordTableSize> used {};
+    bool collision = false;
+    for (const Keyword& keyword : kKeywords) {
+      std::size_t slot = keywordHash(keyword.spelling, seed);
+      if (used[slot]) {
+        collision = true;
+        break;
       }
-
-      // Add the number token with the value from the buffer
-      tokens.push_back({ .type = TokenType::NUMBER, .value = buffer });
-      buffer.clear(); // Clear the buffer for the next token
+      used[slot] = true;
     }
+    if (!collision)
+      return seed;
+  }
+  return 0;
+}
 
-    // Handle various single-character tokens like parentheses, brackets, and operators
-    else if (peek().value() == '(') {
-      consume();
-      tokens.push_back({ .type = TokenType::OPEN_PAREN, .position = m_index });
-    } else if (peek().value() == ')') {
-      consume();
-      tokens.push_back({ .type = TokenType::CLOSE_PAREN, .position = m_index });
-    } else if (peek().value() == '{') {
-      consume();
-      tokens.push_back({ .type = TokenType::OPEN_CURLY, .position = m_index });
-    } else if (peek().value() == '}') {
-      consume();
-      tokens.push_back({ .type = TokenType::CLOSE_CURLY, .position = m_index });
-    } else if (peek().value() == '[') {
-      consume();
-      tokens.push_back({ .type = TokenType::OPEN_BRACKET, .position = m_index });
-    } else if (peek().value() == ']') {
-      consume();
-      tokens.push_back({ .type = TokenType::CLOSE_BRACKET, .position = m_index  });
-    }
+constexpr std::uint32_t kKeywordSeed = findKeywordSeed();
+static_assert(kKeywordSeed != 0, "No collision-free seed found for the keyword hash");
 
-    // Handle two-character operators
-    else if (peek().value() == '=') {
-      consume();
-      if (peek().value() == '=') {
-        consume();
-        tokens.push_back({ .type = TokenType::EQUAL_EQUAL, .position = m_index, .length = 2  });
-      } else {
-        tokens.push_back({ .type = TokenType::EQUAL, .position = m_index });
-      }
-    } else if (peek().value() == '<') {
-      consume();
-      if (peek().value() == '=') {
-        consume();
-        tokens.push_back({ .type = TokenType::LESS_THAN_EQUAL, .position = m_index, .length = 2 });
-      } else {
-        tokens.push_back({ .type = TokenType::LESS_THAN, .position = m_index });
-      }
-    } else if (peek().value() == '>') {
-      consume();
-      if (peek().value() == '=') {
-        consume();
-        tokens.push_back({ .type = TokenType::GREATER_THAN_EQUAL });
-      } else {
-        tokens.push_back({ .type = TokenType::GREATER_THAN });
-      }
-    }
+// Perfect hash table mapping a slot to an index into kKeywords (-1 if empty)
+constexpr std::array<std::int8_t, kKeywordTableSize> kKeywordTable = [] {
+  std::array<std::int8_t, kKeywordTableSize> table {};
+  table.fill(-1);
+  for (std::size_t i = 0; i < kKeywords.size(); i++)
+    table[keywordHash(kKeywords[i].spelling, kKeywordSeed)] = static_cast<std::int8_t>(i);
+  return table;
+}();
+
+}
+
+// Constructor to initialize the lexer with the source string
+Lexer::Lexer(std::string src) : m_src(std::move(src)) {
+  checkSourceSize(m_src.size());
+}
 
-    // Handle single-character operators and punctuation
-    else if (peek().value() == '+') {
-      consume();
-      tokens.push_back({ .type = TokenType::PLUS });
-    } else if (peek().value() ==  '-') {
-      consume();
-      tokens.push_back({ .type = TokenType::MINUS });
-    } else if (peek().value() ==  '*') {
-      consume();
-      tokens.push_back({ .type = TokenType::TIMES });
-    } else if (peek().value() ==  '/') {
-      consume();
-      tokens.push_back({ .type = TokenType::DIVIDE });
-    } else if (peek().value() == ',') {
-      consume();
-      tokens.push_back({ .type = TokenType::COMMA });
-    } else if (peek().value() == ';') {
-      consume();
-      tokens.push_back({ .type = TokenType::SEMICOLON });
+// Token offsets are 32 bits wide
+void Lexer::checkSourceSize(std::size_t size) const {
+  if (size > kMaxSourceSize)
+    DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, "Source files larger than 4 GiB are not supported");
+}
+
+// Build a token spanning from startPosition to index
+Token Lexer::makeToken(TokenType type, std::size_t startPosition, std::size_t index) const {
+  std::size_t length = index - startPosition;
+  if (length > kMaxTokenLength)
+    DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, "Token is too long", startPosition);
+  return { .type = type, .length = static_cast<std::uint16_t>(length), .position = static_cast<std::uint32_t>(startPosition),
+           .number = 0.0 };
+}
+
+const Keyword* Lexer::lookupKeyword(std::string_view word) {
+  std::int8_t index = kKeywordTable[keywordHash(word, kKeywordSeed)];
+  if (index < 0 || kKeywords[index].spelling != word)
+    return nullptr;
+  return &kKeywords[index];
+}
+
+// Tokenize the whole source string into a vector of tokens. This is independent
+// of the position of the next() stream.
+std::vector<Token> Lexer::tokenize(LexMode mode, unsigned threadCount) {
+  m_diagnostics.clear();
+  std::vector<Token> tokens = mode == LexMode::PARALLEL ? tokenizeParallel(threadCount) : tokenizeRange(0, m_src.size(), m_diagnostics);
+  internIdentifiers(tokens, m_src);
+  DECAF_TRACE(LEXER, DecafLogger::Logger::displayTokenList(tokens, m_src));
+  return tokens;
+}
+
+// Tokenize the source between two line starts. Every error leaves the cursor
+// past the offending text, so lexing resumes right after it.
+std::vector<Token> Lexer::tokenizeRange(std::size_t begin, std::size_t end, std::vector<DecafLogger::Diagnostic>& diagnostics) const {
+  std::vector<Token> tokens; // Vector to store the tokens
+  tokens.reserve((end - begin) / 8);
+
+  std::size_t index = begin;
+  while (true) {
+    try {
+      std::optional<Token> token = scanToken(index, end, diagnostics);
+      if (!token)
+        break;
+      tokens.push_back(*token);
+    } catch (const DecafLogger::CompileError& e) {
+      diagnostics.push_back({ .type = DecafLogger::LogType::ERROR, .message = e.what(), .position = e.position });
     }
+  }
 
-    // Skip any comments (beginning with "#")
-    else if (peek().value() == '#') {
-      while (peek().has_value() && peek().value() != '\n' && peek().value() != '\r') {
-        consume();
-      }
+  return tokens; // Return the vector of tokens
+}
+
+// Split the source at line breaks into one chunk per thread, lex the chunks
+// concurrently and stitch the results. Token positions are absolute, so the
+// output is identical to single-threaded lexing.
+//
+// A chunk always begins right after a '\n' or '\r'. Since comments end at a line
+// break and no token spans one, the lexer is in its start state there, so the
+// pre-scan for a chunk only has to find that line break.
+std::vector<Token> Lexer::tokenizeParallel(unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = DecafThreading::ThreadPool::defaultThreadCount();
+  const std::size_t size = m_src.size();
+  const std::size_t chunkCount = std::min<std::size_t>(threadCount, std::max<std::size_t>(1, size / kMinParallelChunkSize));
+  if (chunkCount <= 1)
+    return tokenizeRange(0, size, m_diagnostics);
+
+  std::vector<std::size_t> bounds = { 0 };
+  for (std::size_t i = 1; i < chunkCount; i++) {
+    std::size_t split = std::max(bounds.back(), size * i / chunkCount);
+    split = ScanKernels::findLineEnd(m_src.data(), split, size);
+    if (split < size)
+      split++; // Start the chunk after the line break
+    if (split > bounds.back() && split < size)
+      bounds.push_back(split);
+  }
+  bounds.push_back(size);
+
+  DecafThreading::ThreadPool pool(static_cast<unsigned>(bounds.size() - 1));
+  std::vector<std::future<std::vector<Token>>> chunks;
+  std::vector<std::vector<DecafLogger::Diagnostic>> chunkDiagnostics(bounds.size() - 1);
+  for (std::size_t i = 0; i + 1 < bounds.size(); i++) {
+    chunks.push_back(pool.submit([this, begin = bounds[i], end = bounds[i + 1], &diagnostics = chunkDiagnostics[i]]() {
+      return tokenizeRange(begin, end, diagnostics);
+    }));
+  }
+
+  // Collect in source order, so the diagnostics stay sorted
+  std::vector<std::vector<Token>> results;
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    results.push_back(chunks[i].get());
+    total += results.back().size();
+    m_diagnostics.insert(m_diagnostics.end(), chunkDiagnostics[i].begin(), chunkDiagnostics[i].end());
+  }
+
+  std::vector<Token> tokens;
+  tokens.reserve(total);
+  for (const std::vector<Token>& result : results)
+    tokens.insert(tokens.end(), result.begin(), result.end());
+  return tokens;
+}
+
+TokenRange Lexer::relex(std::vector<Token>& tokens, const SourceEdit& edit) {
+  // Refuse the edit before touching the source, so it stays in sync with tokens
+  checkSourceSize(m_src.size() - edit.removedLength + edit.insertedText.size());
+  m_src.replace(edit.offset, edit.removedLength, edit.insertedText);
+  const std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(edit.insertedText.size()) - static_cast<std::ptrdiff_t>(edit.removedLength);
+  const std::size_t editEnd = edit.offset + edit.insertedText.size(); // End of the edit in the new source
+
+  // No token spans a line break and comments end at one, so the lexer is always in
+  // its start state at the beginning of a line. The text before the edit is
+  // unchanged, so that line start is a safe place to restart from.
+  std::size_t restart = edit.offset;
+  while (restart > 0 && m_src[restart - 1] != '\n' && m_src[restart - 1] != '\r')
+    restart--;
+
+  std::size_t first = std::lower_bound(tokens.begin(), tokens.end(), restart, [](const Token& token, std::size_t position) {
+    return token.position < position;
+  }) - tokens.begin();
+
+  // Re-lex until a token past the edit lines up with an old token of the same type
+  // and length. Both streams are in the start state after it over identical text,
+  // so everything from there on is unchanged apart from the offset. Errors are
+  // collected like tokenizeRange() does, so the splice below always happens.
+  std::vector<Token> relexed;
+  std::vector<DecafLogger::Diagnostic> relexedDiagnostics;
+  std::size_t oldIndex = first;
+  std::size_t resync = tokens.size();
+  std::size_t index = restart;
+  while (true) {
+    std::optional<Token> token;
+    try {
+      token = scanToken(index, m_src.size(), relexedDiagnostics);
+    } catch (const DecafLogger::CompileError& e) {
+      relexedDiagnostics.push_back({ .type = DecafLogger::LogType::ERROR, .message = e.what(), .position = e.position });
+      continue;
     }
-    // Skip whitespace characters
-    else if (std::isspace(peek().value())) {
-      consume();
+    if (!token)
+      break;
+    if (token->position >= editEnd) {
+      std::size_t oldPosition = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(token->position) - delta);
+      while (oldIndex < tokens.size() && tokens[oldIndex].position < oldPosition)
+        oldIndex++;
+      if (oldIndex < tokens.size() && tokens[oldIndex].position == oldPosition
+          && tokens[oldIndex].type == token->type && tokens[oldIndex].length == token->length) {
+        resync = oldIndex;
+        break;
+      }
     }
+    relexed.push_back(*token);
+  }
+  internIdentifiers(relexed, m_src);
+
+  // Splice the re-lexed tokens over [first, resync) and shift the ones after them
+  std::size_t oldCount = resync - first;
+  if (relexed.size() > oldCount)
+    tokens.insert(tokens.begin() + resync, relexed.size() - oldCount, Token {});
+  else
+    tokens.erase(tokens.begin() + first + relexed.size(), tokens.begin() + resync);
+  std::copy(relexed.begin(), relexed.end(), tokens.begin() + first);
+
+  std::size_t newEnd = first + relexed.size();
+  if (delta != 0) {
+    for (std::size_t i = newEnd; i < tokens.size(); i++)
+      tokens[i].position = static_cast<std::uint32_t>(static_cast<std::ptrdiff_t>(tokens[i].position) + delta);
+  }
+
+  // Replace the diagnostics for the re-lexed text, which ends where the first
+  // unchanged token now starts, and shift the ones after it
+  const std::size_t relexedEnd = newEnd < tokens.size() ? tokens[newEnd].position : m_src.size();
+  const std::size_t oldRelexedEnd = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(relexedEnd) - delta);
+  auto firstStale = std::lower_bound(m_diagnostics.begin(), m_diagnostics.end(), restart, [](const DecafLogger::Diagnostic& diagnostic, std::size_t position) {
+    return diagnostic.position < position;
+  });
+  auto lastStale = std::lower_bound(firstStale, m_diagnostics.end(), oldRelexedEnd, [](const DecafLogger::Diagnostic& diagnostic, std::size_t position) {
+    return diagnostic.position < position;
+  });
+  for (auto it = lastStale; it != m_diagnostics.end(); ++it)
+    it->position = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(it->position) + delta);
+  m_diagnostics.insert(m_diagnostics.erase(firstStale, lastStale), relexedDiagnostics.begin(), relexedDiagnostics.end());
+
+  return { .first = first, .oldEnd = resync, .newEnd = newEnd };
+}
+
+// Give every identifier token the symbol of its name
+void Lexer::internIdentifiers(std::span<Token> tokens, std::string_view source) {
+  for (Token& token : tokens) {
+    if (token.type == TokenType::IDENTIFIER)
+      token.symbol = Interner::intern(token.text(source));
+  }
+}
+
+// Pull the next token from the stream
+std::optional<Token> Lexer::next(std::vector<DecafLogger::Diagnostic>& diagnostics) {
+  std::optional<Token> token = scanToken(m_index, m_src.size(), diagnostics);
+  if (token)
+    internIdentifiers({ &*token, 1 }, m_src);
+  DECAF_TRACE(LEXER, if (token) DecafLogger::Logger::displayToken(*token, m_src));
+  return token;
+}
 
-    // Handle unrecognized characters
-    else {
-      DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, DecafLogger::stringFormat("Unrecognized character: %c", peek().value()), m_index);
+// Scan the next token starting at index, or return nothing once index reaches end.
+// Lexing is stateless between tokens, so any line start is a valid starting point.
+std::optional<Token> Lexer::scanToken(std::size_t& index, std::size_t end, std::vector<DecafLogger::Diagnostic>& diagnostics) const {
+  const std::size_t size = m_src.size();
+
+  // Start state: the class of the current character decides which state to scan in.
+  // Runs of whitespace, comment text, identifier characters and digits are consumed
+  // in bulk by the vectorized scan kernels.
+  while (index < end) {
+    const unsigned char c = m_src[index];
+    switch (kCharClass[c]) {
+      case CharClass::WHITESPACE:
+        // Single separators are far more common than runs, so only call into the kernel for runs
+        if (kCharClass[static_cast<unsigned char>(m_src[index + 1])] == CharClass::WHITESPACE)
+          index = ScanKernels::skipWhitespace(m_src.data(), index + 2, size);
+        else
+          index++;
+        break;
+      case CharClass::COMMENT:
+        skipComment(index);
+        break;
+      case CharClass::IDENTIFIER_START:
+        return scanIdentifier(index, diagnostics);
+      case CharClass::DIGIT:
+        return scanNumber(index);
+      case CharClass::PUNCTUATION:
+        index++;
+        return makeToken(kSingleCharToken[c], index - 1, index);
+      case CharClass::OPERATOR:
+        return scanOperator(index);
+      case CharClass::INVALID:
+        index++; // Step over the character, so lexing can resume once the error is handled
+        DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, DecafLogger::stringFormat("Unrecognized character: %c", c), index - 1);
+        break;
     }
   }
 
-  m_index = 0;
-  return tokens; // Return the vector of tokens
+  return {};
+}
+
+// Scan an identifier or keyword starting at the current position
+Token Lexer::scanIdentifier(std::size_t& index, std::vector<DecafLogger::Diagnostic>& diagnostics) const {
+  std::size_t startPosition = index;
+  index = ScanKernels::skipIdentifier(m_src.data(), index + 1, m_src.size());
+
+  std::string_view word(m_src.data() + startPosition, index - startPosition);
+  const Keyword* keyword = lookupKeyword(word);
+
+  if (keyword && !keyword->reserved)
+    return makeToken(keyword->type, startPosition, index);
+
+  if (keyword) { // Warn about reserved keywords being used as identifiers
+    diagnostics.push_back({ .type = DecafLogger::LogType::WARNING,
+                            .message = DecafLogger::stringFormat("Reserved keyword '%s' used as identifier! This can cause issues in later versions of the compiler.", std::string(word).c_str()),
+                            .position = startPosition });
+  }
+
+  return makeToken(TokenType::IDENTIFIER, startPosition, index);
+}
+
+// Scan a numeric literal starting at the current position and convert it to its value:
+//   decimal: digits ['.' digits] [('e' | 'E') ['+' | '-'] digits]
+//   hex:     '0' ('x' | 'X') hexdigits ['.' hexdigits] [('p' | 'P') ['+' | '-'] digits]
+// std::from_chars rounds correctly, so every literal becomes the nearest double.
+Token Lexer::scanNumber(std::size_t& index) const {
+  std::size_t startPosition = index;
+  if (m_src[index] == '0' && (m_src[index + 1] == 'x' || m_src[index + 1] == 'X'))
+    return scanHexNumber(index, startPosition);
+
+  index = ScanKernels::skipDigits(m_src.data(), index + 1, m_src.size());
+  if (m_src[index] == '.')
+    index = ScanKernels::skipDigits(m_src.data(), index + 1, m_src.size());
+  if (m_src[index] == 'e' || m_src[index] == 'E') {
+    // Only an exponent if digits follow; otherwise the 'e' starts the next token
+    std::size_t exponent = index + 1;
+    if (m_src[exponent] == '+' || m_src[exponent] == '-')
+      exponent++;
+    if (kCharClass[static_cast<unsigned char>(m_src[exponent])] == CharClass::DIGIT)
+      index = ScanKernels::skipDigits(m_src.data(), exponent + 1, m_src.size());
+  }
+
+  Token token = makeToken(TokenType::NUMBER, startPosition, index);
+  auto [end, error] = std::from_chars(m_src.data() + startPosition, m_src.data() + index, token.number);
+  if (error == std::errc::result_out_of_range)
+    DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, "Numeric literal is out of range", startPosition);
+  return token;
+}
+
+Token Lexer::scanHexNumber(std::size_t& index, std::size_t startPosition) const {
+  index += 2; // Skip the "0x" prefix
+  std::size_t digitsStart = index;
+  while (std::isxdigit(static_cast<unsigned char>(m_src[index])))
+    index++;
+  if (m_src[index] == '.') {
+    index++;
+    while (std::isxdigit(static_cast<unsigned char>(m_src[index])))
+      index++;
+  }
+  if (index == digitsStart || (index == digitsStart + 1 && m_src[digitsStart] == '.'))
+    DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, "Hexadecimal literal has no digits", startPosition);
+  if (m_src[index] == 'p' || m_src[index] == 'P') {
+    std::size_t exponent = index + 1;
+    if (m_src[exponent] == '+' || m_src[exponent] == '-')
+      exponent++;
+    if (kCharClass[static_cast<unsigned char>(m_src[exponent])] == CharClass::DIGIT)
+      index = ScanKernels::skipDigits(m_src.data(), exponent + 1, m_src.size());
+  }
+
+  Token token = makeToken(TokenType::NUMBER, startPosition, index);
+  auto [end, error] = std::from_chars(m_src.data() + digitsStart, m_src.data() + index, token.number, std::chars_format::hex);
+  if (error == std::errc::result_out_of_range)
+    DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, "Numeric literal is out of range", startPosition);
+  return token;
 }
 
-// Peek at the character at a given offset from the current position
-std::optional<char> Lexer::peek(int offset) {
-  if (m_index + offset >= m_src.length()) {
-    return {}; // Return an empty optional if the offset is out of bounds
-  } else {
-    return m_src.at(m_index + offset); // Return the character at the given offset
+// Scan '=', '<' or '>', optionally followed by '='
+Token Lexer::scanOperator(std::size_t& index) const {
+  const unsigned char c = m_src[index];
+  std::size_t startPosition = index;
+  if (m_src[index + 1] == '=') { // m_src[size()] is '\0', so this is safe on the last character
+    index += 2;
+    return makeToken(kOperatorEqualToken[c], startPosition, index);
   }
+  index++;
+  return makeToken(kSingleCharToken[c], startPosition, index);
 }
 
-// Consume the current character and advance the index
-char Lexer::consume() {
-  return m_src.at(m_index++); // Return the current character and increment the index
+// Skip a comment (beginning with "#") up to the end of the line
+void Lexer::skipComment(std::size_t& index) const {
+  index = ScanKernels::findLineEnd(m_src.data(), index + 1, m_src.size());
 }
 
-}
\ No newline at end of file
+}
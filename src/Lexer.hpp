@@ -1,16 +1,23 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "Diagnostic.hpp"
+#include "Interner.hpp"
+
 #include <iostream>
 #include <iomanip> // For std::setw()
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
 
 namespace DecafScanning {
 
-enum class TokenType {    
+enum class TokenType : std::uint8_t {    
   DEF,
   IF,
   ELSE,
@@ -23,6 +30,9 @@ enum class TokenType {
   VOID,
   TRUE,
   FALSE,
+  VAR,
+  FAST,
+  MEMO,
 
   OPEN_PAREN,
   CLOSE_PAREN,
@@ -45,29 +55,127 @@ enum class TokenType {
   SEMICOLON,
 
   NUMBER,
-  IDENTIFIER
+  IDENTIFIER,
+
+  END_OF_FILE // Never produced by the lexer; the parser's token past the last one
 };
 
+constexpr std::size_t kTokenTypeCount = static_cast<std::size_t>(TokenType::END_OF_FILE) + 1;
+
+// Compact token referring back into the source buffer by offset and length.
+// Numeric literals are converted once by the lexer and carry their value;
+// identifiers carry their interned symbol.
 struct Token {
   TokenType type;
-  std::size_t position;
-  std::optional<std::size_t> length;
-  std::optional<std::string> value {};
+  std::uint16_t length = 0;
+  std::uint32_t position = 0;
+  union {
+    double number = 0.0; // Value of NUMBER tokens
+    Symbol symbol;       // Name of IDENTIFIER tokens
+  };
+
+  std::string_view text(std::string_view source) const { return source.substr(position, length); }
+};
+
+static_assert(sizeof(Token) <= 16, "Token should stay small enough to pack four per cache line");
+
+// Limits implied by the compact token layout
+constexpr std::size_t kMaxSourceSize = UINT32_MAX;
+constexpr std::size_t kMaxTokenLength = UINT16_MAX;
+
+// An edit to the source: removedLength bytes at offset are replaced by insertedText
+struct SourceEdit {
+  std::size_t offset;
+  std::size_t removedLength;
+  std::string_view insertedText;
+};
+
+// Tokens [first, oldEnd) of the previous token array were replaced by [first, newEnd)
+struct TokenRange {
+  std::size_t first;
+  std::size_t oldEnd;
+  std::size_t newEnd;
+};
+
+enum class LexMode {
+  SINGLE_THREADED,
+  PARALLEL // Lex newline-aligned chunks of the source concurrently
+};
+
+// Character classes driving the lexer's dispatch table. Every byte of the
+// source maps to exactly one class, which selects the scanning state entered
+// from the start state.
+enum class CharClass : std::uint8_t {
+  INVALID,
+  WHITESPACE,
+  IDENTIFIER_START, // [A-Za-z_]
+  DIGIT,            // [0-9]
+  COMMENT,          // '#' up to the end of the line
+  PUNCTUATION,      // Always a single-character token
+  OPERATOR          // Single-character token, or two characters when followed by '='
+};
+
+// Entry in the keyword perfect hash table. Reserved words are lexed as
+// identifiers but trigger a warning.
+struct Keyword {
+  std::string_view spelling;
+  TokenType type;
+  bool reserved;
 };
 
 class Lexer {
 public:
   explicit Lexer(std::string src);
-  std::vector<Token> tokenize();
+  // threadCount is only used in parallel mode; 0 means one thread per hardware thread.
+  // Lexing continues past errors, which are collected in diagnostics() along with warnings.
+  std::vector<Token> tokenize(LexMode mode = LexMode::SINGLE_THREADED, unsigned threadCount = 0);
+  // Errors and warnings found by the last tokenize() and the relex() calls since, in source order
+  const std::vector<DecafLogger::Diagnostic>& diagnostics() const { return m_diagnostics; }
+
+  // Pull the next token from the source, or nothing once the end is reached.
+  // Used by the parser to lex lazily instead of materializing the whole token vector.
+  // Warnings are added to the given diagnostics; errors are thrown as a CompileError.
+  std::optional<Token> next(std::vector<DecafLogger::Diagnostic>& diagnostics);
+
+  // Apply an edit to the source and update the given token array (which must be
+  // the result of tokenizing the source before the edit) in place. Only the tokens
+  // from the start of the edited line up to the point where the new token stream
+  // matches the old one again are re-lexed; the rest are shifted. Errors in the
+  // re-lexed text replace the diagnostics previously reported there.
+  TokenRange relex(std::vector<Token>& tokens, const SourceEdit& edit);
+
+  // The buffer that token offsets refer to
+  std::string_view source() const { return m_src; }
+
+  // Returns the keyword entry for the given word, or nullptr for plain identifiers
+  static const Keyword* lookupKeyword(std::string_view word);
 
 private:
   std::string m_src;
   std::size_t m_index = 0;
+  std::vector<DecafLogger::Diagnostic> m_diagnostics;
+
+  // Parallel lexing isn't worth the thread startup below this many bytes per chunk
+  static constexpr std::size_t kMinParallelChunkSize = 1 << 20;
+
+  std::vector<Token> tokenizeRange(std::size_t begin, std::size_t end, std::vector<DecafLogger::Diagnostic>& diagnostics) const;
+  std::vector<Token> tokenizeParallel(unsigned threadCount);
 
-  std::optional<char> peek(int offset = 0);
-  char consume();
+  // The scanning routines are const and advance the cursor they are given, so
+  // several threads can lex different ranges of the same source at once. They
+  // add warnings to the diagnostics of their range and throw errors.
+  std::optional<Token> scanToken(std::size_t& index, std::size_t end, std::vector<DecafLogger::Diagnostic>& diagnostics) const;
+  Token makeToken(TokenType type, std::size_t startPosition, std::size_t index) const;
+  void checkSourceSize(std::size_t size) const;
+  // Interning isn't thread-safe, so it runs on the lexer's own thread after scanning
+  static void internIdentifiers(std::span<Token> tokens, std::string_view source);
+  Token scanIdentifier(std::size_t& index, std::vector<DecafLogger::Diagnostic>& diagnostics) const;
+  Token scanNumber(std::size_t& index) const;
+  Token scanHexNumber(std::size_t& index, std::size_t startPosition) const;
+  Token scanOperator(std::size_t& index) const;
+  void skipComment(std::size_t& index) const;
 };
 
 }
 
-#endif // LEXER_H
\ No newline at end of file
+#endif // LEXER_H
@@ -3,17 +3,56 @@
 using namespace DecafScanning;
 using namespace DecafParsing;
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <stdexcept>
-#include <typeinfo>
+#include <cstdlib>
+#include <array>
 
 namespace DecafLogger {
 
+std::uint32_t Logger::traceMask = 0;
 std::string Logger::fileText;
 std::vector<Line> Logger::lines;
 
+namespace {
+
+constexpr std::array<std::string_view, 6> kTraceCategoryNames = {
+  "lexer", "parser", "codegen", "ir-before", "ir-after", "jit"
+};
+
+}
+
+void Logger::enableTraces(std::string_view categories) {
+  while (!categories.empty()) {
+    std::size_t comma = categories.find(',');
+    std::string_view name = categories.substr(0, comma);
+    categories = comma == std::string_view::npos ? std::string_view() : categories.substr(comma + 1);
+    if (name.empty())
+      continue;
+
+    if (name == "all") {
+      traceMask = (1u << kTraceCategoryNames.size()) - 1;
+      continue;
+    }
+    auto found = std::find(kTraceCategoryNames.begin(), kTraceCategoryNames.end(), name);
+    if (found == kTraceCategoryNames.end())
+      logMessage(LogType::ERROR, stringFormat("Unknown trace category '%s'", std::string(name).c_str()));
+    traceMask |= 1u << (found - kTraceCategoryNames.begin());
+  }
+}
+
+void Logger::enableTracesFromEnvironment() {
+  if (const char* categories = std::getenv("DECAF_TRACE"))
+    enableTraces(categories);
+}
+
+void Logger::trace(TraceCategory category, const std::string& msg) {
+  std::cout << DEBUG_ESCAPE_SEQUENCE << " [" << kTraceCategoryNames[static_cast<std::size_t>(category)] << "] " << msg << '\n';
+}
+
 void Logger::setFile(std::string fileText) {
   Logger::fileText = fileText;
   lines.clear();
@@ -41,83 +80,55 @@ void Logger::logMessage(LogType type, const std::string& msg) {
 }
 
 void Logger::logMessage(LogType type, const std::string& msg, const Token& token) {
-  Line currLine;
-  bool lineFound = false;
-  for (const Line& line : Logger::lines) {
-    if (line.startPosition <= token.position && line.endPosition >= token.position) {
-      currLine = line;
-      lineFound = true;
-      break;
-    }
-  }
-  // Ensure position is within bounds
-  if (!lineFound) {
-    throw std::out_of_range("Position is out of the range of the file content.");
-  }
-
-  switch (type) {
-    case LogType::ERROR:
-      // Print the line number and the line
-      std::cout << ERROR_ESCAPE_SEQUENCE << " Line " << currLine.lineNumber << std::endl;
-      std::cout << currLine.content << std::endl;
-
-      // Print spaces until the caret's position and then print '^'
-      std::cout << std::string(token.position - currLine.startPosition, ' ') << "^" << std::endl;
+  logMessage(type, msg, token.position);
+}
 
-      throw std::runtime_error(msg);
-      break;
-    
-    case LogType::WARNING:
-      // Print the line number and the line
-      std::cout << WARNING_ESCAPE_SEQUENCE << " Line " << currLine.lineNumber << std::endl;
-      std::cout << currLine.content << std::endl;
+// Errors at a position are thrown as a CompileError and printed by whoever
+// collects them, usually through reportDiagnostics(). Warnings print right away.
+void Logger::logMessage(LogType type, const std::string& msg, std::size_t position) {
+  if (type == LogType::ERROR)
+    throw CompileError(msg, position);
+  printAtPosition(type, msg, position);
+}
 
-      // Print spaces until the caret's position and then print '^'
-      std::cout << std::string(token.position - currLine.startPosition, ' ') << "^" << std::endl;
-      std::cout << msg << std::endl;
-      std::cout << std::endl;
-      break;
-  }
+void Logger::reportDiagnostics(const std::vector<Diagnostic>& diagnostics) {
+  // A streaming parser records lexer warnings as its lookahead reaches them,
+  // which can be just before an error at an earlier token
+  std::vector<const Diagnostic*> ordered;
+  for (const Diagnostic& diagnostic : diagnostics)
+    ordered.push_back(&diagnostic);
+  std::stable_sort(ordered.begin(), ordered.end(), [](const Diagnostic* a, const Diagnostic* b) { return a->position < b->position; });
+  for (const Diagnostic* diagnostic : ordered)
+    printAtPosition(diagnostic->type, diagnostic->message, diagnostic->position);
+  if (!diagnostics.empty())
+    std::cout << diagnostics.size() << (diagnostics.size() == 1 ? " problem" : " problems") << " found" << std::endl;
 }
 
-void Logger::logMessage(LogType type, const std::string& msg, std::size_t position) {
-  Line currLine;
-  bool lineFound = false;
+void Logger::printAtPosition(LogType type, const std::string& msg, std::size_t position) {
+  const char* escapeSequence = type == LogType::ERROR ? ERROR_ESCAPE_SEQUENCE
+                             : type == LogType::WARNING ? WARNING_ESCAPE_SEQUENCE
+                             : DEBUG_ESCAPE_SEQUENCE;
+  const Line* currLine = nullptr;
   for (const Line& line : Logger::lines) {
     if (line.startPosition <= position && line.endPosition >= position) {
-      currLine = line;
-      lineFound = true;
+      currLine = &line;
       break;
     }
   }
-  // Ensure position is within bounds
-  if (!lineFound) {
-    throw std::out_of_range("Position is out of the range of the file content.");
+  // Without the file's lines (see setFile()) only the message can be shown
+  if (!currLine) {
+    std::cout << escapeSequence << " " << msg << std::endl << std::endl;
+    return;
   }
 
-  switch (type) {
-    case LogType::ERROR:
-      // Print the line number and the line
-      std::cout << ERROR_ESCAPE_SEQUENCE << " Line " << currLine.lineNumber << std::endl;
-      std::cout << currLine.content << std::endl;
-
-      // Print spaces until the caret's position and then print '^'
-      std::cout << std::string(position - currLine.startPosition, ' ') << "^" << std::endl;
-
-      throw std::runtime_error(msg);
-      break;
-    
-    case LogType::WARNING:
-      // Print the line number and the line
-      std::cout << WARNING_ESCAPE_SEQUENCE << " Line " << currLine.lineNumber << std::endl;
-      std::cout << currLine.content << std::endl;
+  // Print the line number and the line
+  std::cout << escapeSequence << " Line " << currLine->lineNumber << std::endl;
+  std::cout << currLine->content << std::endl;
 
-      // Print spaces until the caret's position and then print '^'
-      std::cout << std::string(position - currLine.startPosition, ' ') << "^" << std::endl;
-      std::cout << msg << std::endl;
-      std::cout << std::endl;
-      break;
-  }
+  // Print spaces until the caret's position and then print '^'
+  std::cout << std::string(position - currLine->startPosition, ' ') << "^" << std::endl;
+  std::cout << msg << std::endl;
+  std::cout << std::endl;
 }
 
 // void Logger::logMessage(LogType type, const std::string& msg, const std::string& fileText, std::size_t position) {
@@ -181,70 +192,76 @@ void Logger::logMessage(LogType type, const std::string& msg, std::size_t positi
 // }
 
 void Logger::displayASTExpr(int level, AST::Expr& expr) {
-  if (typeid(expr) == typeid(AST::NumberExpr)) {
-    AST::NumberExpr* num = dynamic_cast<AST::NumberExpr*>(&expr);
-    std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "") <<  "number: " << num->value << std::endl;
-  }
-  else if (typeid(expr) == typeid(AST::VariableExpr)) {
-    AST::VariableExpr* var = dynamic_cast<AST::VariableExpr*>(&expr);
-    std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "") << "variable: " << var->name << std::endl;
-  }
-  else if (typeid(expr) == typeid(AST::BinaryExpr)) {
-    AST::BinaryExpr* bin = dynamic_cast<AST::BinaryExpr*>(&expr);
-    std::string op;
-    switch(bin->op.type) {
-      case TokenType::TIMES:
-        op = "*";
-        break;
-      case TokenType::DIVIDE:
-        op = "/";
-        break;
-      case TokenType::PLUS:
-        op = "+";
-        break;
-      case TokenType::MINUS:
-        op = "-";
-        break;
-      case TokenType::LESS_THAN:
-        op = "<";
-        break;
-      case TokenType::GREATER_THAN:
-        op = ">";
-        break;
-      case TokenType::LESS_THAN_EQUAL:
-        op = "<=";
-        break;
-      case TokenType::GREATER_THAN_EQUAL:
-        op = ">=";
-        break;
-      case TokenType::EQUAL_EQUAL:
-        op = "==";
-        break;
+  std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "");
+  switch (expr.kind) {
+    case AST::ExprKind::NUMBER:
+      std::cout << "number: " << static_cast<AST::NumberExpr&>(expr).value << std::endl;
+      break;
+    case AST::ExprKind::VARIABLE:
+      std::cout << "variable: " << Interner::name(static_cast<AST::VariableExpr&>(expr).name) << std::endl;
+      break;
+    case AST::ExprKind::BINARY: {
+      std::string op;
+      switch (static_cast<AST::BinaryExpr&>(expr).op.type) {
+        case TokenType::TIMES:
+          op = "*";
+          break;
+        case TokenType::DIVIDE:
+          op = "/";
+          break;
+        case TokenType::PLUS:
+          op = "+";
+          break;
+        case TokenType::MINUS:
+          op = "-";
+          break;
+        case TokenType::LESS_THAN:
+          op = "<";
+          break;
+        case TokenType::GREATER_THAN:
+          op = ">";
+          break;
+        case TokenType::LESS_THAN_EQUAL:
+          op = "<=";
+          break;
+        case TokenType::GREATER_THAN_EQUAL:
+          op = ">=";
+          break;
+        case TokenType::EQUAL_EQUAL:
+          op = "==";
+          break;
+        case TokenType::EQUAL:
+          op = "=";
+          break;
+        case TokenType::SEMICOLON:
+          op = ";";
+          break;
+        default: // The parser builds binary expressions from operator tokens only
+          break;
+      }
+      std::cout << "binary operation: " << op << std::endl;
+      break;
     }
-
-    std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "") <<  "binary operation: " << op << std::endl;
-    Logger::displayASTExpr(level+1, *bin->LHS);
-    Logger::displayASTExpr(level+1, *bin->RHS);
-  }
-  else if (typeid(expr) == typeid(AST::CallExpr)) {
-    AST::CallExpr* call = dynamic_cast<AST::CallExpr*>(&expr);
-    std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "") << "function call: " << call->callee << std::endl;
-    for (auto& expr_ : call->args)
-      Logger::displayASTExpr(level+1, *expr_);
-  }
-  else if (typeid(expr) == typeid(AST::IfExpr)) {
-    AST::IfExpr* ifStatement = dynamic_cast<AST::IfExpr*>(&expr);
-    std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "") << "if/else statement: " << std::endl;
-    Logger::displayASTExpr(level+1, *ifStatement->cond);
-    Logger::displayASTExpr(level+1, *ifStatement->then);
-    Logger::displayASTExpr(level+1, *ifStatement->else_);
-  }
-  else if (typeid(expr) == typeid(AST::WhileExpr)) {
-    AST::WhileExpr* whileStatement = dynamic_cast<AST::WhileExpr*>(&expr);
-    std::cout << std::string(level * 3, ' ') << ((level != 0) ? "└" : "") << "while statement: " << std::endl;
-    Logger::displayASTExpr(level+1, *whileStatement->cond);
-    Logger::displayASTExpr(level+1, *whileStatement->body);
+    case AST::ExprKind::CALL:
+      std::cout << "function call: " << Interner::name(static_cast<AST::CallExpr&>(expr).callee) << std::endl;
+      break;
+    case AST::ExprKind::IF:
+      std::cout << "if/else statement: " << std::endl;
+      break;
+    case AST::ExprKind::WHILE:
+      std::cout << "while statement: " << std::endl;
+      break;
+    case AST::ExprKind::VAR: {
+      auto& var = static_cast<AST::VarExpr&>(expr);
+      std::cout << (var.array ? "array declaration: " : "variable declaration: ") << Interner::name(var.name) << std::endl;
+      break;
+    }
+    case AST::ExprKind::INDEX:
+      std::cout << "array element: " << Interner::name(static_cast<AST::IndexExpr&>(expr).name) << std::endl;
+      break;
   }
+
+  AST::forEachChild(expr, [level](AST::Expr& child) { Logger::displayASTExpr(level + 1, child); });
 }
 
 void Logger::displayASTExpr(AST::Expr& expr) {
@@ -254,14 +271,14 @@ void Logger::displayASTExpr(AST::Expr& expr) {
 }
 
 // Function to display tokens in a readable format
-void Logger::displayTokenList(const std::vector<Token>& tokens) {
+void Logger::displayTokenList(const std::vector<Token>& tokens, std::string_view source) {
   logMessage(LogType::DEBUG_INFO, "Token List");
   for (const auto& token : tokens) {
-    Logger::displayToken(token);
+    Logger::displayToken(token, source);
   }
 }
 
-void Logger::displayToken(const DecafScanning::Token token) {
+void Logger::displayToken(const DecafScanning::Token& token, std::string_view source) {
   switch (token.type) {
     case TokenType::DEF:
       std::cout << "Token Type: DEF\n";
@@ -278,11 +295,41 @@ void Logger::displayToken(const DecafScanning::Token token) {
     case TokenType::RETURN:
       std::cout << "Token Type: RETURN\n";
       break;
+    case TokenType::BREAK:
+      std::cout << "Token Type: BREAK\n";
+      break;
+    case TokenType::CONTINUE:
+      std::cout << "Token Type: CONTINUE\n";
+      break;
+    case TokenType::INT:
+      std::cout << "Token Type: INT\n";
+      break;
+    case TokenType::BOOL:
+      std::cout << "Token Type: BOOL\n";
+      break;
+    case TokenType::VOID:
+      std::cout << "Token Type: VOID\n";
+      break;
+    case TokenType::TRUE:
+      std::cout << "Token Type: TRUE\n";
+      break;
+    case TokenType::FALSE:
+      std::cout << "Token Type: FALSE\n";
+      break;
+    case TokenType::VAR:
+      std::cout << "Token Type: VAR\n";
+      break;
+    case TokenType::FAST:
+      std::cout << "Token Type: FAST\n";
+      break;
+    case TokenType::MEMO:
+      std::cout << "Token Type: MEMO\n";
+      break;
     case TokenType::IDENTIFIER:
-      std::cout << "Token Type: IDENTIFIER, Value: " << *token.value << '\n';
+      std::cout << "Token Type: IDENTIFIER, Value: " << token.text(source) << '\n';
       break;
     case TokenType::NUMBER:
-      std::cout << "Token Type: NUMBER, Value: " << *token.value << '\n';
+      std::cout << "Token Type: NUMBER, Value: " << token.text(source) << '\n';
       break;
     case TokenType::OPEN_PAREN:
       std::cout << "Token Type: OPEN_PAREN\n";
@@ -323,12 +370,24 @@ void Logger::displayToken(const DecafScanning::Token token) {
     case TokenType::PLUS:
       std::cout << "Token Type: PLUS\n";
       break;
+    case TokenType::MINUS:
+      std::cout << "Token Type: MINUS\n";
+      break;
+    case TokenType::TIMES:
+      std::cout << "Token Type: TIMES\n";
+      break;
+    case TokenType::DIVIDE:
+      std::cout << "Token Type: DIVIDE\n";
+      break;
     case TokenType::COMMA:
       std::cout << "Token Type: COMMA\n";
       break;
     case TokenType::SEMICOLON:
       std::cout << "Token Type: SEMICOLON\n";
       break;
+    case TokenType::END_OF_FILE:
+      std::cout << "Token Type: END_OF_FILE\n";
+      break;
   }
 }
 
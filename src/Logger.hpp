@@ -4,12 +4,37 @@
 #include "Logger.hpp"
 #include "Lexer.hpp"
 #include "AST.hpp"
+#include "Diagnostic.hpp"
 
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <string>
 #include <stdexcept>
+#include <string_view>
+#include <cstdint>
+
+// Tracing is compiled in unless this is a release (NDEBUG) build. Define
+// DECAF_TRACING to 0 or 1 to override.
+#ifndef DECAF_TRACING
+#ifdef NDEBUG
+#define DECAF_TRACING 0
+#else
+#define DECAF_TRACING 1
+#endif
+#endif
+
+// Run the given statements only while the trace category is enabled. In builds
+// without tracing the statements are still type-checked but never emitted.
+#if DECAF_TRACING
+#define DECAF_TRACE(category, ...) \
+  do { if (::DecafLogger::Logger::isTracing(::DecafLogger::TraceCategory::category)) { __VA_ARGS__; } } while (false)
+#else
+#define DECAF_TRACE(category, ...) do { if (false) { __VA_ARGS__; } } while (false)
+#endif
+
+#define DECAF_TRACE_MESSAGE(category, msg) \
+  DECAF_TRACE(category, ::DecafLogger::Logger::trace(::DecafLogger::TraceCategory::category, msg))
 
 namespace DecafLogger {
 
@@ -27,10 +52,15 @@ std::string stringFormat( const std::string& format, Args ... args ) {
   return std::string( buf.get(), buf.get() + size - 1 ); // We don't want the '\0' inside
 }
 
-enum class LogType {
-  DEBUG_INFO,
-  ERROR,
-  WARNING
+// Compile phases that can be traced, named on the command line and in
+// DECAF_TRACE as "lexer", "parser", "codegen", "ir-before", "ir-after" and "jit"
+enum class TraceCategory : std::uint8_t {
+  LEXER,
+  PARSER,
+  CODEGEN,
+  IR_BEFORE, // Each function's IR before optimization
+  IR_AFTER,  // Each function's IR after optimization
+  JIT
 };
 
 struct Line {
@@ -45,15 +75,30 @@ public:
   static void logMessage(LogType type, const std::string& msg);
   static void logMessage(LogType type, const std::string& msg, const DecafScanning::Token& token);
   static void logMessage(LogType type, const std::string& msg, std::size_t position);
+  // Print each diagnostic with its line in source order, without throwing
+  static void reportDiagnostics(const std::vector<Diagnostic>& diagnostics);
   // static void logMessage(LogType type, const std::string& msg, const std::string& fileText, std::size_t position);
-  static void displayTokenList(const std::vector<DecafScanning::Token>& tokens);
-  static void displayToken(const DecafScanning::Token token);
+  static void displayTokenList(const std::vector<DecafScanning::Token>& tokens, std::string_view source);
+  static void displayToken(const DecafScanning::Token& token, std::string_view source);
   static void displayASTExpr(int level, DecafParsing::AST::Expr& expr);
   static void displayASTExpr(DecafParsing::AST::Expr& expr);
 
+  // Enable the trace categories in a comma-separated list, or "all"
+  static void enableTraces(std::string_view categories);
+  // Enable the trace categories listed in the DECAF_TRACE environment variable
+  static void enableTracesFromEnvironment();
+  static bool isTracing(TraceCategory category) {
+    return DECAF_TRACING && (traceMask & (1u << static_cast<unsigned>(category))) != 0;
+  }
+  static void trace(TraceCategory category, const std::string& msg);
+
+  static std::uint32_t traceMask;
   static std::string fileText;
   static std::vector<Line> lines;
   static void setFile(std::string fileText);
+
+private:
+  static void printAtPosition(LogType type, const std::string& msg, std::size_t position);
 };
 
 }
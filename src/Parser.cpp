@@ -1,145 +1,303 @@
 #include "Parser.hpp"
-#define DEBUG_LOG DecafLogger::Logger::displayToken(peek().value()); std::cout << "Line "<< __LINE__ << " ran!" << std::endl;
+#include "ThreadPool.hpp"
+
+#include <cassert>
+#include <future>
+#include <cstddef>
+// Trace the token about to be consumed
+#define DEBUG_LOG DECAF_TRACE(PARSER, DecafLogger::Logger::displayToken(peek(), m_src));
 
 namespace DecafParsing {
 
-Parser::Parser(std::vector<DecafScanning::Token> tokens) : m_tokens(tokens) {
-  // 1 is lowest precedence.
-  m_binopPrecedence[DecafScanning::TokenType::TIMES] = 4;
-  m_binopPrecedence[DecafScanning::TokenType::DIVIDE] = 4;
-  m_binopPrecedence[DecafScanning::TokenType::PLUS] = 3;
-  m_binopPrecedence[DecafScanning::TokenType::MINUS] = 3;
-  m_binopPrecedence[DecafScanning::TokenType::LESS_THAN] = 2;
-  m_binopPrecedence[DecafScanning::TokenType::GREATER_THAN] = 2;
-  m_binopPrecedence[DecafScanning::TokenType::LESS_THAN_EQUAL] = 2;
-  m_binopPrecedence[DecafScanning::TokenType::GREATER_THAN_EQUAL] = 2;
-  m_binopPrecedence[DecafScanning::TokenType::EQUAL_EQUAL] = 1;
+namespace {
+
+// Precedence of every binary operator, indexed by token type. 1 is lowest
+// precedence; -1 means the token is not a binary operator. Sequencing with ';'
+// binds loosest, then assignment, which is the only right-associative one.
+constexpr int kSequencePrecedence = 1;
+constexpr int kAssignmentPrecedence = 2;
+constexpr std::array<int, DecafScanning::kTokenTypeCount> kBinopPrecedence = [] {
+  std::array<int, DecafScanning::kTokenTypeCount> table {};
+  table.fill(-1);
+  table[static_cast<std::size_t>(DecafScanning::TokenType::TIMES)] = 6;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::DIVIDE)] = 6;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::PLUS)] = 5;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::MINUS)] = 5;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::LESS_THAN)] = 4;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::GREATER_THAN)] = 4;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::LESS_THAN_EQUAL)] = 4;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::GREATER_THAN_EQUAL)] = 4;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::EQUAL_EQUAL)] = 3;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::EQUAL)] = kAssignmentPrecedence;
+  table[static_cast<std::size_t>(DecafScanning::TokenType::SEMICOLON)] = kSequencePrecedence;
+  return table;
+}();
+
+// Type named by a type keyword, or nothing if the token isn't one
+std::optional<AST::ValueType> typeName(DecafScanning::TokenType type) {
+  switch (type) {
+    case DecafScanning::TokenType::INT:
+      return AST::ValueType::INT;
+    case DecafScanning::TokenType::BOOL:
+      return AST::ValueType::BOOL;
+    default:
+      return std::nullopt;
+  }
+}
+
+// Literals without a fraction or exponent are ints, as long as the lexer's
+// double holds them exactly. That is certain only below 2^53: a literal that
+// converted to 2^53 may have been 2^53 + 1 rounded down.
+AST::ValueType literalType(std::string_view text, double value) {
+  bool hex = text.size() > 1 && (text[1] == 'x' || text[1] == 'X');
+  if (text.find_first_of(hex ? ".pP" : ".eE") != std::string_view::npos || value >= 0x1p53)
+    return AST::ValueType::DOUBLE;
+  return AST::ValueType::INT;
 }
 
+}
+
+Parser::Parser(DecafScanning::Lexer& lexer) : Parser({}, lexer.source()) {
+  m_lexer = &lexer;
+}
+
+Parser::Parser(std::vector<DecafScanning::Token> tokens, std::string_view source)
+  : m_tokens(std::move(tokens)), m_src(source),
+    m_endToken{ .type = DecafScanning::TokenType::END_OF_FILE, .length = 0,
+                .position = static_cast<std::uint32_t>(source.size()), .number = 0.0 } {}
+
+// True once every token has been consumed
 bool Parser::isAtEnd () {
-  return (m_tokens.size()-1) <= m_index;
+  return peek().type == DecafScanning::TokenType::END_OF_FILE;
 }
 
 int Parser::getTokPrecedence() {
-  if (m_binopPrecedence.count(peek().value().type) > 0)
-    return m_binopPrecedence[peek().value().type];
-  else
-    return -1;
+  return kBinopPrecedence[static_cast<std::size_t>(peek().type)];
 }
 
-std::optional<DecafScanning::Token> Parser::peek(int offset) {
-  if (m_index + offset >= m_tokens.size()) {
-    return {}; // Return an empty optional if the offset is out of bounds
-  } else {
-    return m_tokens.at(m_index + offset); // Return the character at the given offset
+// Pull tokens from the lexer until the ring buffer holds the one at the given offset
+bool Parser::fillLookahead(int offset) {
+  while (m_lookaheadCount <= offset) {
+    std::optional<DecafScanning::Token> token = m_lexer->next(m_diagnostics);
+    if (!token)
+      return false;
+    m_lookahead[(m_lookaheadHead + m_lookaheadCount) % kLookahead] = *token;
+    m_lookaheadCount++;
   }
+  return true;
 }
 
-DecafScanning::Token Parser::consume() {
-  return m_tokens.at(m_index++);
+const DecafScanning::Token& Parser::peek(int offset) {
+  if (m_lexer) {
+    assert(offset < kLookahead && "peek past the streaming lookahead window");
+    if (!fillLookahead(offset))
+      return m_endToken;
+    return m_lookahead[(m_lookaheadHead + offset) % kLookahead];
+  }
+
+  if (m_index + offset >= m_tokens.size())
+    return m_endToken; // Past the last token
+  return m_tokens[m_index + offset];
 }
 
-std::unique_ptr<AST::Expr> Parser::numberExpr() {
-  std::cout << "Parse number expression" << std::endl;
-  if (peek().value().type == DecafScanning::TokenType::NUMBER) {
-    auto result = std::make_unique<AST::NumberExpr>(std::stof(*peek().value().value));
-    if (!isAtEnd()) {
-      DEBUG_LOG
+const DecafScanning::Token& Parser::consume() {
+  if (m_lexer) {
+    if (!fillLookahead(0))
+      throw std::out_of_range("Consumed past the end of the token stream.");
+    // The slot is only overwritten once the ring buffer wraps around to it again
+    const DecafScanning::Token& token = m_lookahead[m_lookaheadHead];
+    m_lookaheadHead = (m_lookaheadHead + 1) % kLookahead;
+    m_lookaheadCount--;
+    m_index++;
+    trackConsumed(token);
+    return token;
+  }
+
+  const DecafScanning::Token& token = m_tokens.at(m_index++);
+  trackConsumed(token);
+  return token;
+}
+
+// Keep the brace depth and the end of the previous token for synchronize()
+void Parser::trackConsumed(const DecafScanning::Token& token) {
+  if (token.type == DecafScanning::TokenType::OPEN_CURLY)
+    m_braceDepth++;
+  else if (token.type == DecafScanning::TokenType::CLOSE_CURLY)
+    m_braceDepth--;
+  m_previousTokenEnd = token.position + token.length;
+}
+
+// Record an error at the current token. Only the first error of a unit is
+// recorded; the ones after it are usually knock-on effects of the first.
+std::nullptr_t Parser::error(const std::string& msg) {
+  if (!m_unitFailed)
+    m_diagnostics.push_back({ .type = DecafLogger::LogType::ERROR, .message = msg, .position = peek().position });
+  m_unitFailed = true;
+  return nullptr;
+}
+
+// Panic-mode recovery after a unit failed to parse: skip tokens up to the next
+// `def`, or the next token outside braces that starts a new line and can begin
+// a top-level expression. At least one token is skipped if the failed unit
+// consumed none, so the caller always makes progress.
+void Parser::synchronize() {
+  if (m_index == m_unitStart && peek().type != DecafScanning::TokenType::END_OF_FILE)
+    consume();
+
+  while (true) {
+    try {
+      if (atSynchronizationPoint())
+        return;
       consume();
+    } catch (const DecafLogger::CompileError& e) { // Lexer errors in the skipped text are still reported
+      m_diagnostics.push_back({ .type = DecafLogger::LogType::ERROR, .message = e.what(), .position = e.position });
     }
+  }
+}
+
+bool Parser::atSynchronizationPoint() {
+  const DecafScanning::Token& token = peek();
+  switch (token.type) {
+    case DecafScanning::TokenType::END_OF_FILE:
+    case DecafScanning::TokenType::DEF:
+      return true;
+    case DecafScanning::TokenType::IDENTIFIER:
+    case DecafScanning::TokenType::NUMBER:
+    case DecafScanning::TokenType::TRUE:
+    case DecafScanning::TokenType::FALSE:
+    case DecafScanning::TokenType::OPEN_PAREN:
+    case DecafScanning::TokenType::IF:
+    case DecafScanning::TokenType::WHILE:
+    case DecafScanning::TokenType::VAR:
+      return m_braceDepth <= 0 && m_src.substr(m_previousTokenEnd, token.position - m_previousTokenEnd).find_first_of("\n\r") != std::string_view::npos;
+    default:
+      return false;
+  }
+}
+
+AST::Expr* Parser::numberExpr() {
+  DECAF_TRACE_MESSAGE(PARSER, "Parse number expression");
+  if (peek().type == DecafScanning::TokenType::NUMBER) {
+    auto result = m_arena.make<AST::NumberExpr>(peek().number, literalType(peek().text(m_src), peek().number));
+    DEBUG_LOG
+    consume();
     return result;
   }
   
-  return nullptr; // Todo: Throw error
+  return error("Expected a number");
 }
 
-std::unique_ptr<AST::Expr> Parser::groupingExpr() {
-  std::cout << "Parse grouping expression" << std::endl;
-  if (peek().value().type == DecafScanning::TokenType::OPEN_PAREN) {
+AST::Expr* Parser::booleanExpr() {
+  DECAF_TRACE_MESSAGE(PARSER, "Parse boolean expression");
+  auto result = m_arena.make<AST::NumberExpr>(peek().type == DecafScanning::TokenType::TRUE ? 1.0 : 0.0, AST::ValueType::BOOL);
+  DEBUG_LOG
+  consume();
+  return result;
+}
+
+AST::Expr* Parser::groupingExpr() {
+  DECAF_TRACE_MESSAGE(PARSER, "Parse grouping expression");
+  if (peek().type == DecafScanning::TokenType::OPEN_PAREN) {
     DEBUG_LOG
     consume();
     auto expr = parseExpr();
     if (!expr)
       return nullptr;
-    if (peek().value().type == DecafScanning::TokenType::CLOSE_PAREN) {
-      if (!isAtEnd()) {
-        DEBUG_LOG
-        consume();
-      }
+    if (peek().type == DecafScanning::TokenType::CLOSE_PAREN) {
+      DEBUG_LOG
+      consume();
       return expr;
     }
+    return error("Expected ')' after expression");
   }
   
-  return nullptr; // Todo: Throw error
+  return error("Expected '('");
 }
 
-std::unique_ptr<AST::Expr> Parser::identifierExpr() {
-  std::cout << "Parse identifier expression" << std::endl;
+AST::Expr* Parser::identifierExpr() {
+  DECAF_TRACE_MESSAGE(PARSER, "Parse identifier expression");
+
+  if (peek().type == DecafScanning::TokenType::IDENTIFIER) {
+    DecafScanning::Symbol name = peek().symbol;
+    std::uint32_t position = peek().position;
+    DEBUG_LOG
+    consume();
 
-  if (peek().value().type == DecafScanning::TokenType::IDENTIFIER) {
-    std::string name = *peek().value().value;
-    if (!isAtEnd()) {
+    if (peek().type == DecafScanning::TokenType::OPEN_BRACKET) { // Array element
       DEBUG_LOG
       consume();
+      auto index = parseExpr();
+      if (!index)
+        return nullptr;
+      if (peek().type != DecafScanning::TokenType::CLOSE_BRACKET)
+        return error("Expected ']' after index");
+      DEBUG_LOG
+      consume();
+      auto element = m_arena.make<AST::IndexExpr>(name, index);
+      element->position = position;
+      return element;
     }
 
-    if (peek().value().type != DecafScanning::TokenType::OPEN_PAREN) // Simple variable reference
-      return std::make_unique<AST::VariableExpr>(name);
+    if (peek().type != DecafScanning::TokenType::OPEN_PAREN) { // Simple variable reference
+      auto variable = m_arena.make<AST::VariableExpr>(name);
+      variable->position = position;
+      return variable;
+    }
     
     // Function call
     DEBUG_LOG
     consume();
-    std::vector<std::unique_ptr<AST::Expr>> args;
+    std::size_t argsBase = m_argStack.size();
     while (true) {
       if (auto arg = parseExpr()) { // Parse arguments
-        args.push_back(std::move(arg));
+        m_argStack.push_back(arg);
       }
       else {
-        DecafLogger::Logger::logMessage(DecafLogger::LogType::ERROR, "Failed to parse argument", peek().value());
-        return nullptr; // Todo: Throw error
+        m_argStack.resize(argsBase);
+        return nullptr;
       }
 
-      if (peek().value().type == DecafScanning::TokenType::CLOSE_PAREN) { // End of function call
-        std::cout << "why this no run :(" << std::endl;
+      if (peek().type == DecafScanning::TokenType::CLOSE_PAREN) // End of function call
         break;
-      }
 
-      if (peek().value().type != DecafScanning::TokenType::COMMA) {
-        std::cout << "Expected ')' or ',' in argument list" << std::endl;
-        return nullptr; // Todo: Throw an error
+      if (peek().type != DecafScanning::TokenType::COMMA) {
+        m_argStack.resize(argsBase);
+        return error("Expected ')' or ',' in argument list");
       }
       DEBUG_LOG
       consume();
     }
-    if (!isAtEnd()) {
-      DEBUG_LOG
-      consume(); // Consume ')'
-    }
-    return std::make_unique<AST::CallExpr>(name, std::move(args));
+    DEBUG_LOG
+    consume(); // Consume ')'
+    std::span<AST::Expr*> args = m_arena.copyArray(std::span<AST::Expr* const>(m_argStack).subspan(argsBase));
+    m_argStack.resize(argsBase);
+    auto call = m_arena.make<AST::CallExpr>(name, args);
+    call->position = position;
+    return call;
   }
 
-  return nullptr; // Todo: Throw error
+  return error("Expected an identifier");
 }
 
-std::unique_ptr<AST::Expr> Parser::conditionalExpr() {
-  if (peek().value().type == DecafScanning::TokenType::IF) 
+AST::Expr* Parser::conditionalExpr() {
+  if (peek().type == DecafScanning::TokenType::IF) 
     { DEBUG_LOG consume(); } // eat the If
-  else return nullptr;
-  if (peek().value().type == DecafScanning::TokenType::OPEN_PAREN) 
+  else return error("Expected 'if'");
+  if (peek().type == DecafScanning::TokenType::OPEN_PAREN) 
     { DEBUG_LOG consume(); }  // eat the (
   else
-    return nullptr;
+    return error("Expected '(' after 'if'");
 
   auto cond = parseExpr();
   if (!cond)
     return nullptr;
 
-  if (peek().value().type == DecafScanning::TokenType::CLOSE_PAREN) 
+  if (peek().type == DecafScanning::TokenType::CLOSE_PAREN) 
     { DEBUG_LOG consume(); }  // eat the )
   else 
-    return nullptr;
-  if (peek().value().type != DecafScanning::TokenType::OPEN_CURLY)
-    return nullptr; // To-do: Throw error
+    return error("Expected ')' after condition");
+  if (peek().type != DecafScanning::TokenType::OPEN_CURLY)
+    return error("Expected '{' before 'if' body");
   DEBUG_LOG
   consume();  // eat the {
 
@@ -147,17 +305,17 @@ std::unique_ptr<AST::Expr> Parser::conditionalExpr() {
   if (!then)
     return nullptr;
 
-  if (peek().value().type == DecafScanning::TokenType::CLOSE_CURLY) 
+  if (peek().type == DecafScanning::TokenType::CLOSE_CURLY) 
     { DEBUG_LOG consume(); } // eat the }
   else 
-    return nullptr;
+    return error("Expected '}' after 'if' body");
 
-  if (peek().value().type != DecafScanning::TokenType::ELSE)
-    return nullptr; // To-do: Throw error
+  if (peek().type != DecafScanning::TokenType::ELSE)
+    return error("Expected 'else' after 'if' body");
   DEBUG_LOG
   consume();
-  if (peek().value().type != DecafScanning::TokenType::OPEN_CURLY)
-    return nullptr; // To-do: Throw error
+  if (peek().type != DecafScanning::TokenType::OPEN_CURLY)
+    return error("Expected '{' before 'else' body");
   DEBUG_LOG
   consume();  // eat the {
 
@@ -165,38 +323,35 @@ std::unique_ptr<AST::Expr> Parser::conditionalExpr() {
   if (!else_)
     return nullptr;
 
-  if (peek().value().type == DecafScanning::TokenType::CLOSE_CURLY) {
-    if (!isAtEnd()) {
-      DEBUG_LOG
-      consume();
-    }
-  } // Eat the } if not at end
+  if (peek().type == DecafScanning::TokenType::CLOSE_CURLY) {
+    DEBUG_LOG
+    consume();
+  }
   else 
-    return nullptr;
+    return error("Expected '}' after 'else' body");
 
-  return std::make_unique<AST::IfExpr>(std::move(cond), std::move(then),
-                                      std::move(else_));
+  return m_arena.make<AST::IfExpr>(cond, then, else_);
 }
 
-std::unique_ptr<AST::Expr> Parser::whileExpr() {
-  if (peek().value().type == DecafScanning::TokenType::WHILE) 
+AST::Expr* Parser::whileExpr() {
+  if (peek().type == DecafScanning::TokenType::WHILE) 
     { DEBUG_LOG consume(); } // eat the while
-  else return nullptr;
-  if (peek().value().type == DecafScanning::TokenType::OPEN_PAREN) 
+  else return error("Expected 'while'");
+  if (peek().type == DecafScanning::TokenType::OPEN_PAREN) 
     { DEBUG_LOG consume(); }  // eat the (
   else
-    return nullptr;
+    return error("Expected '(' after 'while'");
 
   auto cond = parseExpr();
   if (!cond)
     return nullptr;
 
-  if (peek().value().type == DecafScanning::TokenType::CLOSE_PAREN) 
+  if (peek().type == DecafScanning::TokenType::CLOSE_PAREN) 
     { DEBUG_LOG consume(); }  // eat the )
   else 
-    return nullptr;
-  if (peek().value().type != DecafScanning::TokenType::OPEN_CURLY)
-    return nullptr; // To-do: Throw error
+    return error("Expected ')' after condition");
+  if (peek().type != DecafScanning::TokenType::OPEN_CURLY)
+    return error("Expected '{' before 'while' body");
   DEBUG_LOG
   consume();  // eat the {
 
@@ -204,20 +359,90 @@ std::unique_ptr<AST::Expr> Parser::whileExpr() {
   if (!body)
     return nullptr;
 
-  if (peek().value().type == DecafScanning::TokenType::CLOSE_CURLY) {
-    if (!isAtEnd()) {
-      DEBUG_LOG
-      consume();
-    }
-  } // Eat the } if not at end
+  if (peek().type == DecafScanning::TokenType::CLOSE_CURLY) {
+    DEBUG_LOG
+    consume();
+  }
   else 
+    return error("Expected '}' after 'while' body");
+
+  return m_arena.make<AST::WhileExpr>(cond, body);
+}
+
+// var [int|bool] name = init; body
+// var [int] name[size]; body
+AST::Expr* Parser::varExpr() {
+  if (peek().type == DecafScanning::TokenType::VAR)
+    { DEBUG_LOG consume(); } // eat the var
+  else return error("Expected 'var'");
+
+  // Unannotated locals are doubles, like arguments
+  AST::ValueType varType = AST::ValueType::DOUBLE;
+  if (std::optional<AST::ValueType> type = typeName(peek().type)) {
+    varType = *type;
+    DEBUG_LOG
+    consume();
+  }
+
+  if (peek().type != DecafScanning::TokenType::IDENTIFIER)
+    return error("Expected variable name after 'var'");
+  DecafScanning::Symbol name = peek().symbol;
+  DEBUG_LOG
+  consume();
+
+  if (peek().type == DecafScanning::TokenType::OPEN_BRACKET) {
+    if (varType == AST::ValueType::BOOL)
+      return error("Arrays hold doubles or ints");
+    DEBUG_LOG
+    consume();
+    std::uint32_t sizePosition = peek().position;
+    auto size = parseExpr();
+    if (!size)
+      return nullptr;
+    if (peek().type != DecafScanning::TokenType::CLOSE_BRACKET)
+      return error("Expected ']' after array size");
+    DEBUG_LOG
+    consume();
+    if (peek().type != DecafScanning::TokenType::SEMICOLON)
+      return error("Expected ';' after array declaration");
+    DEBUG_LOG
+    consume();
+
+    auto body = parseExpr();
+    if (!body)
+      return nullptr;
+    auto array = m_arena.make<AST::VarExpr>(name, varType, size, body, /*array*/ true);
+    array->position = sizePosition;
+    return array;
+  }
+
+  if (peek().type != DecafScanning::TokenType::EQUAL)
+    return error("Expected '=' after variable name");
+  DEBUG_LOG
+  consume();
+
+  // The initializer ends at the ';', which leads to the variable's scope
+  auto init = parsePrimaryExpr();
+  if (!init)
+    return nullptr;
+  init = parseBinaryExpr(kSequencePrecedence + 1, init);
+  if (!init)
+    return nullptr;
+
+  if (peek().type != DecafScanning::TokenType::SEMICOLON)
+    return error("Expected ';' after variable initializer");
+  DEBUG_LOG
+  consume();
+
+  auto body = parseExpr();
+  if (!body)
     return nullptr;
 
-  return std::make_unique<AST::WhileExpr>(std::move(cond), std::move(body));
+  return m_arena.make<AST::VarExpr>(name, varType, init, body);
 }
 
-std::unique_ptr<AST::Expr> Parser::parseBinaryExpr(int exprPrec, std::unique_ptr<AST::Expr> LHS) {
-  std::cout << "Parse binary expression" << std::endl;
+AST::Expr* Parser::parseBinaryExpr(int exprPrec, AST::Expr* LHS) {
+  DECAF_TRACE_MESSAGE(PARSER, "Parse binary expression");
   if (isAtEnd()) // End of token sequence
     return LHS; // Can't be binary
   while (true) {
@@ -231,137 +456,172 @@ std::unique_ptr<AST::Expr> Parser::parseBinaryExpr(int exprPrec, std::unique_ptr
     }
 
     // Ok, we know this must be a binary value at this point
-    DecafScanning::Token binOp = peek().value();
+    DecafScanning::Token binOp = peek();
+    if (binOp.type == DecafScanning::TokenType::EQUAL && LHS->kind != AST::ExprKind::VARIABLE && LHS->kind != AST::ExprKind::INDEX)
+      return error("Expected a variable before '='");
     DEBUG_LOG
     consume();
 
     // Parse the primary expression after the binary operator.
     auto RHS = parsePrimaryExpr();
-    if (!RHS) {
-      std::cout << "no right hand side???" << std::endl; // To-do: Throw error
+    if (!RHS)
       return nullptr;
-    }
     
     // If BinOp binds less tightly with RHS than the operator after RHS, let
-    // the pending operator take RHS as its LHS
+    // the pending operator take RHS as its LHS. Assignments chain to the right.
     int nextPrec = getTokPrecedence();
-    if (tokPrec < nextPrec) {
-      RHS = parseBinaryExpr(tokPrec + 1, std::move(RHS));
+    if (tokPrec < nextPrec || (tokPrec == kAssignmentPrecedence && nextPrec == tokPrec)) {
+      RHS = parseBinaryExpr(tokPrec < nextPrec ? tokPrec + 1 : tokPrec, RHS);
       if (!RHS) {
         return nullptr;
       }
     }
 
     // Merge LHS/RHS for complete binary expression
-    LHS = std::make_unique<AST::BinaryExpr>(binOp, std::move(LHS), std::move(RHS));
+    LHS = m_arena.make<AST::BinaryExpr>(binOp, LHS, RHS);
   }
 }
 
-std::unique_ptr<AST::Prototype> Parser::parsePrototype() {
-  if (peek().value().type != DecafScanning::TokenType::IDENTIFIER)
-    return nullptr; // Todo: Throw Error
+AST::Prototype* Parser::parsePrototype() {
+  // Optional fast-math and memoization opt-ins, in either order
+  bool fastMath = false, memoize = false;
+  while (peek().type == DecafScanning::TokenType::FAST || peek().type == DecafScanning::TokenType::MEMO) {
+    (peek().type == DecafScanning::TokenType::FAST ? fastMath : memoize) = true;
+    DEBUG_LOG
+    consume();
+  }
+
+  // Optional return type
+  AST::ValueType returnType = AST::ValueType::DOUBLE;
+  if (std::optional<AST::ValueType> type = typeName(peek().type)) {
+    returnType = *type;
+    DEBUG_LOG
+    consume();
+  }
+
+  if (peek().type != DecafScanning::TokenType::IDENTIFIER)
+    return error("Expected function name");
   // Get function name
-  std::string fnName = *peek().value().value;
+  DecafScanning::Symbol fnName = peek().symbol;
   DEBUG_LOG
   consume();
 
-  if (peek().value().type != DecafScanning::TokenType::OPEN_PAREN)
-    return nullptr; // Todo: Throw error
+  if (peek().type != DecafScanning::TokenType::OPEN_PAREN)
+    return error("Expected '(' after function name");
   DEBUG_LOG
   consume();
 
-  // Read the list of argument names.
-  std::vector<std::string> argNames;
-  while (peek().value().type == DecafScanning::TokenType::IDENTIFIER || peek().value().type == DecafScanning::TokenType::COMMA) {
-    if (peek().value().type == DecafScanning::TokenType::IDENTIFIER) {
-      argNames.push_back(*peek().value().value);
+  // Read the list of argument names, each optionally preceded by its type.
+  m_nameStack.clear();
+  m_typeStack.clear();
+  AST::ValueType argType = AST::ValueType::DOUBLE;
+  while (peek().type == DecafScanning::TokenType::IDENTIFIER || peek().type == DecafScanning::TokenType::COMMA || typeName(peek().type)) {
+    if (std::optional<AST::ValueType> type = typeName(peek().type)) {
+      argType = *type;
+    }
+    else if (peek().type == DecafScanning::TokenType::IDENTIFIER) {
+      m_nameStack.push_back(peek().symbol);
+      m_typeStack.push_back(argType);
+      argType = AST::ValueType::DOUBLE;
     }
     DEBUG_LOG
     consume();
   }
 
-  if (peek().value().type != DecafScanning::TokenType::CLOSE_PAREN)
-    return nullptr; // Todo: Throw an error
+  if (peek().type != DecafScanning::TokenType::CLOSE_PAREN)
+    return error("Expected ')' after parameter list");
   DEBUG_LOG
   consume();
 
-  return std::make_unique<AST::Prototype>(fnName, std::move(argNames));
+  std::span<const DecafScanning::Symbol> argNames = m_arena.copyArray(std::span<const DecafScanning::Symbol>(m_nameStack));
+  std::span<const AST::ValueType> argTypes = m_arena.copyArray(std::span<const AST::ValueType>(m_typeStack));
+  AST::Prototype* proto = m_arena.make<AST::Prototype>(fnName, argNames, argTypes, returnType);
+  proto->fastMath = fastMath;
+  proto->memoize = memoize;
+  return proto;
 }
 
-std::unique_ptr<AST::Function> Parser::parseFuncDefinition() {
-  if (peek().value().type == DecafScanning::TokenType::DEF) {
+AST::Function* Parser::parseFuncDefinition() {
+  return parseUnit([this]() { return funcDefinition(); });
+}
+
+AST::Function* Parser::funcDefinition() {
+  if (peek().type == DecafScanning::TokenType::DEF) {
     DEBUG_LOG
     consume();
     auto proto = parsePrototype(); // Parse function declaration
     if (!proto) return nullptr;
 
-    if (peek().value().type != DecafScanning::TokenType::OPEN_CURLY) {
-      std::cout << "{ expected after function declaration!" << std::endl;
-      return nullptr;
-    }
+    if (peek().type != DecafScanning::TokenType::OPEN_CURLY)
+      return error("Expected '{' after function declaration");
 
     DEBUG_LOG
     consume();
 
     auto expr = parseExpr(); // Parse function body
-    if (peek().value().type != DecafScanning::TokenType::CLOSE_CURLY) {
-      std::cout << "} expected after function definition!" << std::endl;
+    if (!expr)
       return nullptr;
-    }
+    if (peek().type != DecafScanning::TokenType::CLOSE_CURLY)
+      return error("Expected '}' after function body");
     DEBUG_LOG
     consume();
 
-    if (expr) {
-      return std::make_unique<AST::Function>(std::move(proto), std::move(expr));
-    }
-
-    return nullptr;
+    return m_arena.make<AST::Function>(proto, expr);
   }
 
-  return nullptr; // Todo: Throw an error
+  return error("Expected 'def'");
 }
 
-std::unique_ptr<AST::Expr> Parser::parsePrimaryExpr() {
+AST::Expr* Parser::parsePrimaryExpr() {
   // Parse basic, not bin-op expressions
-  switch (peek().value().type) {
+  switch (peek().type) {
     default:
-      return nullptr; // Todo: Throw an error
+      return error("Expected an expression");
     case DecafScanning::TokenType::IDENTIFIER:
       return identifierExpr();
     case DecafScanning::TokenType::NUMBER:
       return numberExpr();
+    case DecafScanning::TokenType::TRUE:
+    case DecafScanning::TokenType::FALSE:
+      return booleanExpr();
     case DecafScanning::TokenType::OPEN_PAREN:
       return groupingExpr();
     case DecafScanning::TokenType::IF:
       return conditionalExpr();
     case DecafScanning::TokenType::WHILE:
       return whileExpr();
+    case DecafScanning::TokenType::VAR:
+      return varExpr();
   }
 }
 
-std::unique_ptr<AST::Expr> Parser::parseExpr() {
+AST::Expr* Parser::parseExpr() {
   // Parse any expression (including both the primary ones and bin-ops)
   auto LHS = parsePrimaryExpr();
 
   if (!LHS)
     return nullptr;
   
-  auto expr = parseBinaryExpr(0, std::move(LHS));
+  auto expr = parseBinaryExpr(0, LHS);
   return expr;
 }
 
-std::unique_ptr<AST::Function> Parser::parseTopLevelExpr() {
+AST::Function* Parser::parseTopLevelExpr() {
+  return parseUnit([this]() { return topLevelExpr(); });
+}
+
+AST::Function* Parser::topLevelExpr() {
   if (auto expr = parseExpr()) {
-    std::cout << "Finished parsing top level statement" << std::endl;
-    auto proto = std::make_unique<AST::Prototype>("__anon_expr", std::vector<std::string>());
-    return std::make_unique<AST::Function>(std::move(proto), std::move(expr));
+    DECAF_TRACE_MESSAGE(PARSER, "Finished parsing top level statement");
+    auto proto = m_arena.make<AST::Prototype>(DecafScanning::kAnonymousFunction, std::span<const DecafScanning::Symbol>());
+    return m_arena.make<AST::Function>(proto, expr);
   }
   return nullptr;
 }
 
-std::unique_ptr<AST::Function> Parser::parse() {
+AST::Function* Parser::parse() {
   // Parse program consiting of functions or (To-do) top level declarations
-  switch (peek().value().type) {
+  switch (peek().type) {
     default:
       return parseTopLevelExpr(); // Todo: Throw an error
     case DecafScanning::TokenType::DEF:
@@ -369,4 +629,78 @@ std::unique_ptr<AST::Function> Parser::parse() {
   }
 }
 
-}
\ No newline at end of file
+std::vector<AST::Function*> Parser::parseProgram(ParseMode mode, unsigned threadCount) {
+  if (mode == ParseMode::PARALLEL && !m_lexer)
+    return parseProgramParallel(threadCount);
+
+  std::vector<AST::Function*> functions;
+  while (!isAtEnd()) {
+    AST::Function* function = peek().type == DecafScanning::TokenType::DEF ? parseFuncDefinition() : parseTopLevelExpr();
+    if (function)
+      functions.push_back(function);
+    else
+      synchronize();
+  }
+  return functions;
+}
+
+// Split the remaining tokens into one chunk per thread, parse the chunks
+// concurrently and concatenate the results.
+//
+// A chunk always begins at a `def` outside of any braces. Every construct is
+// closed before the next top-level `def`, so each chunk parses exactly as it
+// would in the single-threaded loop. The split points come from one pass of
+// brace matching over the tokens.
+std::vector<AST::Function*> Parser::parseProgramParallel(unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = DecafThreading::ThreadPool::defaultThreadCount();
+  const std::size_t begin = m_index;
+  const std::size_t size = m_tokens.size();
+  const std::size_t chunkCount = std::min<std::size_t>(threadCount, std::max<std::size_t>(1, (size - begin) / kMinParallelChunkTokens));
+  if (chunkCount <= 1)
+    return parseProgram(ParseMode::SINGLE_THREADED);
+
+  std::vector<std::size_t> bounds = { begin };
+  int depth = 0;
+  for (std::size_t i = begin; i < size && bounds.size() < chunkCount; i++) {
+    switch (m_tokens[i].type) {
+      case DecafScanning::TokenType::OPEN_CURLY:
+        depth++;
+        break;
+      case DecafScanning::TokenType::CLOSE_CURLY:
+        depth--;
+        break;
+      case DecafScanning::TokenType::DEF:
+        if (depth == 0 && i - begin >= (size - begin) * bounds.size() / chunkCount)
+          bounds.push_back(i);
+        break;
+      default:
+        break;
+    }
+  }
+  bounds.push_back(size);
+
+  DecafThreading::ThreadPool pool(static_cast<unsigned>(bounds.size() - 1));
+  std::vector<std::future<std::vector<AST::Function*>>> chunks;
+  for (std::size_t i = 0; i + 1 < bounds.size(); i++) {
+    m_chunkParsers.push_back(std::make_unique<Parser>(
+        std::vector<DecafScanning::Token>(m_tokens.begin() + bounds[i], m_tokens.begin() + bounds[i + 1]), m_src));
+    chunks.push_back(pool.submit([parser = m_chunkParsers.back().get()]() {
+      return parser->parseProgram(ParseMode::SINGLE_THREADED);
+    }));
+  }
+  m_index = size;
+
+  // Collect in source order, so diagnostics stay sorted and the first unexpected
+  // exception in the file is the one rethrown
+  std::vector<AST::Function*> functions;
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    std::vector<AST::Function*> result = chunks[i].get();
+    functions.insert(functions.end(), result.begin(), result.end());
+    const std::vector<DecafLogger::Diagnostic>& diagnostics = m_chunkParsers[m_chunkParsers.size() - chunks.size() + i]->diagnostics();
+    m_diagnostics.insert(m_diagnostics.end(), diagnostics.begin(), diagnostics.end());
+  }
+  return functions;
+}
+
+}
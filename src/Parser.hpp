@@ -4,40 +4,127 @@
 #include "Lexer.hpp"
 #include "Logger.hpp"
 #include "AST.hpp"
+#include "Arena.hpp"
 
+#include <algorithm>
 #include <memory>
-#include <map>
+#include <optional>
 #include <utility>
 
 namespace DecafParsing {
 
+enum class ParseMode {
+  SINGLE_THREADED,
+  PARALLEL // Parse chunks of top-level definitions concurrently
+};
+
 class Parser {
 public:
-  explicit Parser(std::vector<DecafScanning::Token> tokens);
-
-  std::unique_ptr<AST::Function> parse();
-  std::unique_ptr<AST::Expr> parseBinaryExpr(int exprPrec, std::unique_ptr<AST::Expr> LHS);
-  std::unique_ptr<AST::Prototype> parsePrototype();
-  std::unique_ptr<AST::Function> parseFuncDefinition();
-  std::unique_ptr<AST::Expr> parsePrimaryExpr();
-  std::unique_ptr<AST::Expr> parseExpr();
-  std::unique_ptr<AST::Function> parseTopLevelExpr();
-
-  DecafScanning::Token consume();
-  std::optional<DecafScanning::Token> peek(int offset = 0);
+  Parser(std::vector<DecafScanning::Token> tokens, std::string_view source);
+  // Streaming mode: tokens are pulled from the lexer on demand, which must outlive the parser
+  explicit Parser(DecafScanning::Lexer& lexer);
+
+  // The returned nodes are owned by the parser's arena and live as long as the parser
+  AST::Function* parse();
+  AST::Expr* parseBinaryExpr(int exprPrec, AST::Expr* LHS);
+  AST::Prototype* parsePrototype();
+  AST::Function* parseFuncDefinition();
+  AST::Expr* parsePrimaryExpr();
+  AST::Expr* parseExpr();
+  AST::Function* parseTopLevelExpr();
+
+  // Parse the remaining definitions and top-level expressions, returned in source
+  // order. Parts that fail to parse are skipped a token at a time. Parallel mode
+  // needs the token vector and falls back to single-threaded in streaming mode;
+  // threadCount 0 means one thread per hardware thread.
+  std::vector<AST::Function*> parseProgram(ParseMode mode = ParseMode::SINGLE_THREADED, unsigned threadCount = 0);
+
+  // Skip ahead to the start of the next unit after parseFuncDefinition() or
+  // parseTopLevelExpr() returned nullptr
+  void synchronize();
+  // Errors of every unit that failed to parse, in source order. A parser that
+  // pulls tokens from a lexer also collects its warnings as they are lexed.
+  const std::vector<DecafLogger::Diagnostic>& diagnostics() const { return m_diagnostics; }
+  bool hasErrors() const {
+    return std::any_of(m_diagnostics.begin(), m_diagnostics.end(),
+                       [](const DecafLogger::Diagnostic& diagnostic) { return diagnostic.type == DecafLogger::LogType::ERROR; });
+  }
+
+  // The cursor hands out references into the token storage and never copies.
+  // A reference stays valid until the cursor is next used. Past the last token,
+  // peek() returns a token of type END_OF_FILE.
+  const DecafScanning::Token& consume();
+  const DecafScanning::Token& peek(int offset = 0);
   bool isAtEnd();
 
+  // The buffer that token offsets refer to
+  std::string_view source() const { return m_src; }
+
 private:
   std::vector<DecafScanning::Token> m_tokens;
-  std::map<DecafScanning::TokenType, int> m_binopPrecedence;
+  std::string_view m_src;
+  DecafScanning::Token m_endToken;
+
+  // Lookahead ring buffer used in streaming mode. peek(offset) needs at most
+  // kLookahead - 1 tokens beyond the current one.
+  static constexpr int kLookahead = 4;
+  DecafScanning::Lexer* m_lexer = nullptr;
+  std::array<DecafScanning::Token, kLookahead> m_lookahead {};
+  int m_lookaheadHead = 0;
+  int m_lookaheadCount = 0;
+  bool fillLookahead(int offset);
   int getTokPrecedence();
-  int m_index = 0;
+  std::size_t m_index = 0;
+
+  // All AST nodes of this compilation unit, freed in bulk with the parser
+  DecafMemory::Arena m_arena;
+  // Scratch stacks for lists that are copied into the arena once complete.
+  // Nested calls push their arguments above their caller's.
+  std::vector<AST::Expr*> m_argStack;
+  std::vector<DecafScanning::Symbol> m_nameStack;
+  std::vector<AST::ValueType> m_typeStack;
+
+  // Parallel parsing isn't worth the thread startup below this many tokens per chunk
+  static constexpr std::size_t kMinParallelChunkTokens = 1 << 12;
+  // Parsers of the chunks of a parallel parse, kept alive for the nodes in their arenas
+  std::vector<std::unique_ptr<Parser>> m_chunkParsers;
+  std::vector<AST::Function*> parseProgramParallel(unsigned threadCount);
+
+  // Error recovery state. A unit is one definition or top-level expression.
+  std::vector<DecafLogger::Diagnostic> m_diagnostics;
+  std::size_t m_unitStart = 0;
+  bool m_unitFailed = false;
+  int m_braceDepth = 0;
+  std::size_t m_previousTokenEnd = 0;
+  void trackConsumed(const DecafScanning::Token& token);
+  std::nullptr_t error(const std::string& msg);
+  bool atSynchronizationPoint();
+
+  // Parse one unit, turning errors thrown by the lexer into diagnostics
+  template<typename F>
+  AST::Function* parseUnit(F parse) {
+    m_unitStart = m_index;
+    m_unitFailed = false;
+    m_braceDepth = 0;
+    try {
+      return parse();
+    } catch (const DecafLogger::CompileError& e) {
+      if (!m_unitFailed)
+        m_diagnostics.push_back({ .type = DecafLogger::LogType::ERROR, .message = e.what(), .position = e.position });
+      m_unitFailed = true;
+      return nullptr;
+    }
+  }
+  AST::Function* funcDefinition();
+  AST::Function* topLevelExpr();
 
-  std::unique_ptr<AST::Expr> numberExpr();
-  std::unique_ptr<AST::Expr> groupingExpr();
-  std::unique_ptr<AST::Expr> identifierExpr();
-  std::unique_ptr<AST::Expr> conditionalExpr();
-  std::unique_ptr<AST::Expr> whileExpr();
+  AST::Expr* numberExpr();
+  AST::Expr* booleanExpr();
+  AST::Expr* groupingExpr();
+  AST::Expr* identifierExpr();
+  AST::Expr* conditionalExpr();
+  AST::Expr* whileExpr();
+  AST::Expr* varExpr();
 };
 
 }
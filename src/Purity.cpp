@@ -0,0 +1,58 @@
+#include "Purity.hpp"
+
+namespace DecafParsing {
+
+const FunctionEffects PurityAnalysis::kUnknown;
+
+const FunctionEffects& PurityAnalysis::effects(std::uint32_t function) const {
+  return function < m_effects.size() ? m_effects[function] : kUnknown;
+}
+
+const FunctionEffects& PurityAnalysis::analyze(AST::Function& function, bool memoize) {
+  const std::uint32_t self = function.proto->function;
+  FunctionEffects result { .pure = true, .willReturn = true, .memoized = false, .accessesMemory = false };
+
+  auto walk = [&](auto& walk, AST::Expr& expr) -> void {
+    switch (expr.kind) {
+      case AST::ExprKind::WHILE: // May loop forever
+        result.willReturn = false;
+        break;
+      case AST::ExprKind::VAR: // Allocating on the heap is memory access, even if it's private
+        if (static_cast<AST::VarExpr&>(expr).onHeap())
+          result.accessesMemory = true;
+        break;
+      case AST::ExprKind::CALL: {
+        std::uint32_t callee = static_cast<AST::CallExpr&>(expr).function;
+        if (callee == self) { // Assumed pure, but may recurse forever
+          result.willReturn = false;
+          break;
+        }
+        const FunctionEffects& calleeEffects = effects(callee);
+        result.pure &= calleeEffects.pure;
+        result.willReturn &= calleeEffects.willReturn;
+        result.accessesMemory |= calleeEffects.accessesMemory;
+        break;
+      }
+      default:
+        break;
+    }
+    AST::forEachChild(expr, [&](AST::Expr& child) { walk(walk, child); });
+  };
+  walk(walk, *function.body);
+
+  if (!result.pure) {
+    result.willReturn = false;
+    result.accessesMemory = true;
+  }
+  if (memoize && result.pure && !function.proto->args.empty()) {
+    result.memoized = true;
+    result.accessesMemory = true;
+  }
+
+  if (self >= m_effects.size())
+    m_effects.resize(self + 1, kUnknown);
+  m_effects[self] = result;
+  return m_effects[self];
+}
+
+}
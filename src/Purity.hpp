@@ -0,0 +1,41 @@
+#ifndef PURITY_H
+#define PURITY_H
+
+#include "AST.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace DecafParsing {
+
+// What calling a function can do
+struct FunctionEffects {
+  bool pure = false;          // The result depends only on the arguments and there are no side effects
+  bool willReturn = false;    // Provably returns: no loops and no recursion
+  bool memoized = false;      // Results are cached in a memo table
+  bool accessesMemory = true; // Touches memory, directly or through a callee, e.g. a memo table or heap array
+};
+
+// Infers the effects of functions from their bodies. Expressions have no side
+// effects of their own, so a function is pure when all its callees are.
+// Functions are analyzed one at a time in definition order: callees must have
+// been analyzed first, and calls to functions that haven't been are assumed to
+// do anything. Recursion is fine as long as it is direct.
+class PurityAnalysis {
+public:
+  // Analyze a resolved function. With memoize, pure functions with arguments
+  // are marked for memoization.
+  const FunctionEffects& analyze(AST::Function& function, bool memoize);
+  // Effects of a function by ID; unknown functions may do anything
+  const FunctionEffects& effects(std::uint32_t function) const;
+  // Forget every function, before analyzing a new program
+  void clear() { m_effects.clear(); }
+
+private:
+  std::vector<FunctionEffects> m_effects; // Indexed by function ID
+  static const FunctionEffects kUnknown;
+};
+
+}
+
+#endif // PURITY_H
@@ -0,0 +1,220 @@
+#include "Resolver.hpp"
+#include "Logger.hpp"
+
+#include <utility>
+
+namespace DecafParsing {
+
+std::uint32_t Resolver::functionId(DecafScanning::Symbol name) {
+  if (name >= m_functionIds.size())
+    m_functionIds.resize(DecafScanning::Interner::count(), AST::kUnresolved);
+  std::uint32_t& id = m_functionIds[name];
+  if (id == AST::kUnresolved)
+    id = m_functionCount++;
+  return id;
+}
+
+void Resolver::clear() {
+  m_functionIds.clear();
+  m_functionCount = 0;
+  m_prototypes.clear();
+  m_diagnostics.clear();
+}
+
+void Resolver::declare(AST::Prototype& proto) {
+  proto.function = functionId(proto.name);
+  if (proto.function >= m_prototypes.size())
+    m_prototypes.resize(proto.function + 1);
+  m_prototypes[proto.function] = &proto;
+}
+
+void Resolver::resolve(AST::Function& function) {
+  AST::Prototype& proto = *function.proto;
+  std::uint32_t id = functionId(proto.name);
+  AST::Prototype* previous = id < m_prototypes.size() ? m_prototypes[id] : nullptr;
+  std::size_t errors = m_diagnostics.size();
+  declare(proto);
+  m_function = &proto;
+
+  // Arguments take the first slots. A repeated name refers to its last
+  // occurrence, the one that would win when filling a name-keyed table.
+  if (m_slots.size() < DecafScanning::Interner::count())
+    m_slots.resize(DecafScanning::Interner::count(), AST::kUnresolved);
+  m_slotTypes.clear();
+  m_slotArrays.clear();
+  for (std::uint32_t slot = 0; slot < proto.args.size(); slot++) {
+    m_slots[proto.args[slot]] = slot;
+    m_slotTypes.push_back(proto.argType(slot));
+    m_slotArrays.push_back(false);
+  }
+
+  resolveExpr(*function.body);
+  function.slotCount = static_cast<std::uint32_t>(m_slotTypes.size());
+
+  for (DecafScanning::Symbol arg : proto.args)
+    m_slots[arg] = AST::kUnresolved;
+
+  // A function with errors isn't generated, so later calls can't refer to it
+  if (m_diagnostics.size() != errors)
+    m_prototypes[id] = previous;
+}
+
+void Resolver::error(const std::string& msg, std::size_t position) {
+  m_diagnostics.push_back({ .type = DecafLogger::LogType::ERROR, .message = msg, .position = position });
+}
+
+bool Resolver::bindVariable(AST::VariableExpr& variable) {
+  variable.slot = m_slots[variable.name];
+  if (variable.slot != AST::kUnresolved && m_slotArrays[variable.slot])
+    variable.slot = AST::kUnresolved;
+  if (variable.slot == AST::kUnresolved)
+    return false;
+  variable.type = m_slotTypes[variable.slot];
+  return true;
+}
+
+// Children are resolved first, since the type of a node depends on theirs
+void Resolver::resolveExpr(AST::Expr& expr) {
+  // A local is only in scope in its body, not in its own initializer
+  if (expr.kind == AST::ExprKind::VAR) {
+    auto& var = static_cast<AST::VarExpr&>(expr);
+    resolveExpr(*var.init);
+    if (var.array && var.init->type != AST::ValueType::INT) // Not a whole number
+      error("Array size must be an int", var.position);
+    var.slot = static_cast<std::uint32_t>(m_slotTypes.size());
+    m_slotTypes.push_back(var.varType);
+    m_slotArrays.push_back(var.array);
+    std::uint32_t shadowed = std::exchange(m_slots[var.name], var.slot);
+    resolveExpr(*var.body);
+    m_slots[var.name] = shadowed;
+    var.type = var.body->type;
+    return;
+  }
+
+  // A variable assigned to isn't read, so it is reported as the target instead
+  if (expr.kind == AST::ExprKind::BINARY) {
+    auto& binary = static_cast<AST::BinaryExpr&>(expr);
+    if (binary.op.type == DecafScanning::TokenType::EQUAL && binary.LHS->kind == AST::ExprKind::VARIABLE) {
+      auto& target = static_cast<AST::VariableExpr&>(*binary.LHS);
+      resolveExpr(*binary.RHS);
+      if (!bindVariable(target))
+        error(DecafLogger::stringFormat("Can't assign to '%s', which is not a variable in scope",
+                                        std::string(DecafScanning::Interner::name(target.name)).c_str()),
+              binary.op.position);
+      binary.type = target.type; // The value assigned, converted to the variable's type
+      return;
+    }
+  }
+
+  AST::forEachChild(expr, [this](AST::Expr& child) { resolveExpr(child); });
+
+  switch (expr.kind) {
+    case AST::ExprKind::NUMBER: // Typed by the parser
+      break;
+    case AST::ExprKind::VARIABLE: {
+      auto& variable = static_cast<AST::VariableExpr&>(expr);
+      if (!bindVariable(variable))
+        error(DecafLogger::stringFormat("'%s' is not a variable in scope", std::string(DecafScanning::Interner::name(variable.name)).c_str()), variable.position);
+      break;
+    }
+    case AST::ExprKind::INDEX: {
+      auto& index = static_cast<AST::IndexExpr&>(expr);
+      index.slot = m_slots[index.name];
+      if (index.slot != AST::kUnresolved && !m_slotArrays[index.slot])
+        index.slot = AST::kUnresolved;
+      if (index.slot != AST::kUnresolved)
+        index.type = m_slotTypes[index.slot];
+      else
+        error(DecafLogger::stringFormat("'%s' is not an array in scope", std::string(DecafScanning::Interner::name(index.name)).c_str()), index.position);
+      break;
+    }
+    case AST::ExprKind::BINARY: {
+      auto& binary = static_cast<AST::BinaryExpr&>(expr);
+      switch (binary.op.type) {
+        case DecafScanning::TokenType::LESS_THAN:
+        case DecafScanning::TokenType::GREATER_THAN:
+        case DecafScanning::TokenType::LESS_THAN_EQUAL:
+        case DecafScanning::TokenType::GREATER_THAN_EQUAL:
+        case DecafScanning::TokenType::EQUAL_EQUAL:
+          binary.type = AST::ValueType::BOOL;
+          break;
+        case DecafScanning::TokenType::EQUAL: // The value assigned, converted to the element's type
+          binary.type = binary.LHS->type;
+          break;
+        case DecafScanning::TokenType::SEMICOLON:
+          binary.type = binary.RHS->type;
+          break;
+        default:
+          binary.type = AST::arithmeticType(binary.LHS->type, binary.RHS->type);
+          break;
+      }
+      break;
+    }
+    case AST::ExprKind::CALL: {
+      auto& call = static_cast<AST::CallExpr&>(expr);
+      call.function = functionId(call.callee);
+      const AST::Prototype* callee = call.function < m_prototypes.size() ? m_prototypes[call.function] : nullptr;
+      std::string name(DecafScanning::Interner::name(call.callee));
+      if (!callee)
+        error(DecafLogger::stringFormat("Unknown function '%s'", name.c_str()), call.position);
+      else if (call.args.size() != callee->args.size())
+        error(DecafLogger::stringFormat("Wrong number of arguments to '%s': expected %zu, got %zu", name.c_str(), callee->args.size(), call.args.size()),
+              call.position);
+      else
+        call.type = callee->returnType;
+      break;
+    }
+    case AST::ExprKind::IF: {
+      auto& ifExpr = static_cast<AST::IfExpr&>(expr);
+      ifExpr.type = AST::commonType(ifExpr.then->type, ifExpr.else_->type);
+      break;
+    }
+    case AST::ExprKind::WHILE: // Always evaluates to 0.0
+      break;
+    case AST::ExprKind::VAR: // Resolved above
+      break;
+  }
+}
+
+void Resolver::markTailCalls(AST::Function& function) {
+  function.selfTailCalls = false;
+  markTailCalls(function, *function.body, function.proto->returnType);
+}
+
+void Resolver::markTailCalls(AST::Function& function, AST::Expr& expr, AST::ValueType resultType) {
+  if (expr.type != resultType) // Converted after evaluation
+    return;
+
+  switch (expr.kind) {
+    case AST::ExprKind::CALL: {
+      auto& call = static_cast<AST::CallExpr&>(expr);
+      call.tail = true;
+      if (call.function == function.proto->function)
+        function.selfTailCalls = true;
+      break;
+    }
+    case AST::ExprKind::IF: {
+      auto& ifExpr = static_cast<AST::IfExpr&>(expr);
+      markTailCalls(function, *ifExpr.then, resultType);
+      markTailCalls(function, *ifExpr.else_, resultType);
+      break;
+    }
+    case AST::ExprKind::BINARY: {
+      auto& binary = static_cast<AST::BinaryExpr&>(expr);
+      if (binary.op.type == DecafScanning::TokenType::SEMICOLON)
+        markTailCalls(function, *binary.RHS, resultType);
+      break;
+    }
+    case AST::ExprKind::VAR: {
+      // A heap array is freed after its scope, so nothing in it is returned directly
+      auto& var = static_cast<AST::VarExpr&>(expr);
+      if (!var.onHeap())
+        markTailCalls(function, *var.body, resultType);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "AST.hpp"
+#include "Diagnostic.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace DecafParsing {
+
+// Binds every name in a function to an index so code generation never looks
+// anything up by string: variable references get the slot of the argument or
+// local they name, and prototypes and calls get a function ID. Locals are
+// numbered after the arguments and shadow outer names within their scope.
+// Arrays can only be indexed and scalars can't be, so a name used the wrong
+// way stays unresolved. Function IDs are dense and
+// shared by all functions resolved with the same resolver, so a call resolved
+// before its callee is defined still refers to it.
+//
+// Once its names are bound, every expression is given its type. A call must
+// name a function resolved or declared before it and pass as many arguments
+// as it takes. Resolving continues past errors, which are collected in
+// diagnostics(); a function with errors must not be generated, and later
+// calls can't refer to it.
+class Resolver {
+public:
+  void resolve(AST::Function& function);
+  // Bind a prototype to its function ID ahead of its definition, so that calls
+  // resolved before the definition know its signature
+  void declare(AST::Prototype& proto);
+  // Mark the calls whose value the function returns without converting it:
+  // the body itself, or an arm of an if, the last expression of a sequence or
+  // the scope of a local in tail position. Run after every
+  // pass that rewrites the body.
+  void markTailCalls(AST::Function& function);
+  // Forget every function and diagnostic, before resolving a new program
+  void clear();
+
+  // ID of the function with the given name, allocating one on first use
+  std::uint32_t functionId(DecafScanning::Symbol name);
+  std::uint32_t functionCount() const { return m_functionCount; }
+
+  const std::vector<DecafLogger::Diagnostic>& diagnostics() const { return m_diagnostics; }
+  bool hasErrors() const { return !m_diagnostics.empty(); }
+
+private:
+  std::vector<std::uint32_t> m_functionIds; // Indexed by symbol
+  std::uint32_t m_functionCount = 0;
+  std::vector<AST::Prototype*> m_prototypes; // Indexed by function ID
+  std::vector<std::uint32_t> m_slots;       // Indexed by symbol, for the function being resolved
+  std::vector<AST::ValueType> m_slotTypes;  // Indexed by slot; element types for arrays
+  std::vector<bool> m_slotArrays;           // Indexed by slot
+  AST::Prototype* m_function = nullptr;
+  std::vector<DecafLogger::Diagnostic> m_diagnostics;
+
+  void resolveExpr(AST::Expr& expr);
+  bool bindVariable(AST::VariableExpr& variable); // False for an unknown name or an array
+  void error(const std::string& msg, std::size_t position);
+  void markTailCalls(AST::Function& function, AST::Expr& expr, AST::ValueType resultType);
+};
+
+}
+
+#endif // RESOLVER_H
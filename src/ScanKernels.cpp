@@ -0,0 +1,249 @@
+#include "ScanKernels.hpp"
+
+#include <array>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DECAF_SCAN_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define DECAF_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace DecafScanning {
+
+namespace {
+
+// Scalar byte predicates, shared by the scalar kernel and the vector kernels' tails
+constexpr bool isWhitespace(unsigned char c) {
+  return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+constexpr bool isLineEnd(unsigned char c) {
+  return c == '\n' || c == '\r';
+}
+
+constexpr bool isIdentifierChar(unsigned char c) {
+  return static_cast<unsigned char>((c | 0x20) - 'a') <= 'z' - 'a'
+      || static_cast<unsigned char>(c - '0') <= 9
+      || c == '_';
+}
+
+constexpr bool isDigit(unsigned char c) {
+  return static_cast<unsigned char>(c - '0') <= 9;
+}
+
+template<bool (*Pred)(unsigned char)>
+std::size_t scalarSkip(const char* src, std::size_t index, std::size_t size) {
+  while (index < size && Pred(static_cast<unsigned char>(src[index])))
+    index++;
+  return index;
+}
+
+template<bool (*Pred)(unsigned char)>
+std::size_t scalarFind(const char* src, std::size_t index, std::size_t size) {
+  while (index < size && !Pred(static_cast<unsigned char>(src[index])))
+    index++;
+  return index;
+}
+
+#if DECAF_SCAN_X86
+
+// Each matcher returns a byte mask with 0xFF in every lane that belongs to the run.
+// Unsigned range checks use the min_epu8 trick: (x - lo) <= n  <=>  min(x - lo, n) == x - lo
+
+inline __m128i sse2InRange(__m128i v, char lo, char n) {
+  __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(n)), shifted);
+}
+
+inline __m128i sse2Whitespace(__m128i v) {
+  return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), sse2InRange(v, '\t', '\r' - '\t'));
+}
+
+inline __m128i sse2LineEnd(__m128i v) {
+  return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+inline __m128i sse2Digit(__m128i v) {
+  return sse2InRange(v, '0', 9);
+}
+
+inline __m128i sse2IdentifierChar(__m128i v) {
+  __m128i letter = sse2InRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+  __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(letter, sse2Digit(v)), underscore);
+}
+
+// Advance 16 bytes at a time while every lane matches (Skip) or none does (!Skip)
+template<__m128i (*Match)(__m128i), bool (*Pred)(unsigned char), bool Skip>
+std::size_t sse2Scan(const char* src, std::size_t index, std::size_t size) {
+  while (index + 16 <= size) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + index));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(Match(v)));
+    if (Skip)
+      mask = ~mask & 0xFFFFu;
+    if (mask)
+      return index + __builtin_ctz(mask);
+    index += 16;
+  }
+  return Skip ? scalarSkip<Pred>(src, index, size) : scalarFind<Pred>(src, index, size);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2InRange(__m256i v, char lo, char n) {
+  __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(n)), shifted);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2Whitespace(__m256i v) {
+  return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), avx2InRange(v, '\t', '\r' - '\t'));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2LineEnd(__m256i v) {
+  return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2Digit(__m256i v) {
+  return avx2InRange(v, '0', 9);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2IdentifierChar(__m256i v) {
+  __m256i letter = avx2InRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+  __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  return _mm256_or_si256(_mm256_or_si256(letter, avx2Digit(v)), underscore);
+}
+
+// Same as sse2Scan, 32 bytes at a time. The remainder goes through the SSE2 kernel.
+template<__m256i (*Match)(__m256i), __m128i (*Match128)(__m128i), bool (*Pred)(unsigned char), bool Skip>
+__attribute__((target("avx2"))) std::size_t avx2Scan(const char* src, std::size_t index, std::size_t size) {
+  while (index + 32 <= size) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + index));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(Match(v)));
+    if (Skip)
+      mask = ~mask;
+    if (mask)
+      return index + __builtin_ctz(mask);
+    index += 32;
+  }
+  return sse2Scan<Match128, Pred, Skip>(src, index, size);
+}
+
+#endif
+
+#if DECAF_SCAN_NEON
+
+inline uint8x16_t neonWhitespace(uint8x16_t v) {
+  uint8x16_t space = vceqq_u8(v, vdupq_n_u8(' '));
+  uint8x16_t control = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t'));
+  return vorrq_u8(space, control);
+}
+
+inline uint8x16_t neonLineEnd(uint8x16_t v) {
+  return vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r')));
+}
+
+inline uint8x16_t neonDigit(uint8x16_t v) {
+  return vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+}
+
+inline uint8x16_t neonIdentifierChar(uint8x16_t v) {
+  uint8x16_t letter = vcleq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a')), vdupq_n_u8('z' - 'a'));
+  uint8x16_t underscore = vceqq_u8(v, vdupq_n_u8('_'));
+  return vorrq_u8(vorrq_u8(letter, neonDigit(v)), underscore);
+}
+
+// NEON has no movemask; narrowing each 16-bit lane by 4 leaves one nibble per byte
+template<uint8x16_t (*Match)(uint8x16_t), bool (*Pred)(unsigned char), bool Skip>
+std::size_t neonScan(const char* src, std::size_t index, std::size_t size) {
+  while (index + 16 <= size) {
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(src + index));
+    uint8x16_t match = Match(v);
+    if (Skip)
+      match = vmvnq_u8(match);
+    std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+    if (mask)
+      return index + (__builtin_ctzll(mask) >> 2);
+    index += 16;
+  }
+  return Skip ? scalarSkip<Pred>(src, index, size) : scalarFind<Pred>(src, index, size);
+}
+
+#endif
+
+}
+
+bool ScanKernels::makeTable(ScanKernelKind kind, Table& table) {
+  switch (kind) {
+    case ScanKernelKind::SCALAR:
+      table = { kind, scalarSkip<isWhitespace>, scalarFind<isLineEnd>, scalarSkip<isIdentifierChar>, scalarSkip<isDigit> };
+      return true;
+#if DECAF_SCAN_X86
+    case ScanKernelKind::SSE2:
+      table = { kind,
+                sse2Scan<sse2Whitespace, isWhitespace, true>,
+                sse2Scan<sse2LineEnd, isLineEnd, false>,
+                sse2Scan<sse2IdentifierChar, isIdentifierChar, true>,
+                sse2Scan<sse2Digit, isDigit, true> };
+      return true;
+    case ScanKernelKind::AVX2:
+      if (!__builtin_cpu_supports("avx2"))
+        return false;
+      table = { kind,
+                avx2Scan<avx2Whitespace, sse2Whitespace, isWhitespace, true>,
+                avx2Scan<avx2LineEnd, sse2LineEnd, isLineEnd, false>,
+                avx2Scan<avx2IdentifierChar, sse2IdentifierChar, isIdentifierChar, true>,
+                avx2Scan<avx2Digit, sse2Digit, isDigit, true> };
+      return true;
+#endif
+#if DECAF_SCAN_NEON
+    case ScanKernelKind::NEON:
+      table = { kind,
+                neonScan<neonWhitespace, isWhitespace, true>,
+                neonScan<neonLineEnd, isLineEnd, false>,
+                neonScan<neonIdentifierChar, isIdentifierChar, true>,
+                neonScan<neonDigit, isDigit, true> };
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+ScanKernels::Table ScanKernels::s_active = [] {
+  Table table;
+  makeTable(ScanKernels::detect(), table);
+  return table;
+}();
+
+ScanKernelKind ScanKernels::detect() {
+#if DECAF_SCAN_X86
+  if (__builtin_cpu_supports("avx2"))
+    return ScanKernelKind::AVX2;
+  return ScanKernelKind::SSE2;
+#elif DECAF_SCAN_NEON
+  return ScanKernelKind::NEON;
+#else
+  return ScanKernelKind::SCALAR;
+#endif
+}
+
+bool ScanKernels::select(ScanKernelKind kind) {
+  return makeTable(kind, s_active);
+}
+
+std::string_view ScanKernels::name(ScanKernelKind kind) {
+  switch (kind) {
+    case ScanKernelKind::SCALAR:
+      return "scalar";
+    case ScanKernelKind::SSE2:
+      return "sse2";
+    case ScanKernelKind::AVX2:
+      return "avx2";
+    case ScanKernelKind::NEON:
+      return "neon";
+  }
+  return "unknown";
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef SCAN_KERNELS_H
+#define SCAN_KERNELS_H
+
+#include <cstddef>
+#include <string_view>
+
+namespace DecafScanning {
+
+enum class ScanKernelKind {
+  SCALAR,
+  SSE2,
+  AVX2,
+  NEON
+};
+
+// Bulk scanning routines used by the lexer for the byte runs that make up most
+// of a source file. Each routine takes the buffer, the index to start at and the
+// buffer size, and returns the index of the first byte that ends the run (or size).
+// The implementation is picked once at startup from the host CPU's features.
+class ScanKernels {
+public:
+  // Skip a run of whitespace (' ', '\t', '\n', '\v', '\f', '\r')
+  static std::size_t skipWhitespace(const char* src, std::size_t index, std::size_t size) {
+    return s_active.skipWhitespace(src, index, size);
+  }
+  // Find the end of the current line ('\n' or '\r'), used to skip comments
+  static std::size_t findLineEnd(const char* src, std::size_t index, std::size_t size) {
+    return s_active.findLineEnd(src, index, size);
+  }
+  // Skip a run of identifier characters ([A-Za-z0-9_])
+  static std::size_t skipIdentifier(const char* src, std::size_t index, std::size_t size) {
+    return s_active.skipIdentifier(src, index, size);
+  }
+  // Skip a run of decimal digits
+  static std::size_t skipDigits(const char* src, std::size_t index, std::size_t size) {
+    return s_active.skipDigits(src, index, size);
+  }
+
+  // Best kernel supported by the host CPU
+  static ScanKernelKind detect();
+  // Switch to the given kernel; returns false (and keeps the current one) if the host can't run it
+  static bool select(ScanKernelKind kind);
+  static ScanKernelKind selected() { return s_active.kind; }
+  static std::string_view name(ScanKernelKind kind);
+
+private:
+  using ScanFn = std::size_t (*)(const char*, std::size_t, std::size_t);
+
+  struct Table {
+    ScanKernelKind kind;
+    ScanFn skipWhitespace;
+    ScanFn findLineEnd;
+    ScanFn skipIdentifier;
+    ScanFn skipDigits;
+  };
+
+  static Table s_active;
+  static bool makeTable(ScanKernelKind kind, Table& table);
+};
+
+}
+
+#endif // SCAN_KERNELS_H
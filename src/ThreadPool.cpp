@@ -0,0 +1,44 @@
+#include "ThreadPool.hpp"
+
+namespace DecafThreading {
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = defaultThreadCount();
+  m_workers.reserve(threadCount);
+  for (unsigned i = 0; i < threadCount; i++)
+    m_workers.emplace_back([this]() { workerLoop(); });
+}
+
+// Finish the queued tasks, then join the workers
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wakeUp.notify_all();
+  for (std::thread& worker : m_workers)
+    worker.join();
+}
+
+unsigned ThreadPool::defaultThreadCount() {
+  unsigned count = std::thread::hardware_concurrency();
+  return count == 0 ? 1 : count;
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeUp.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+      if (m_tasks.empty())
+        return; // Stopping and nothing left to run
+      task = std::move(m_tasks.front());
+      m_tasks.pop();
+    }
+    task();
+  }
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace DecafThreading {
+
+// Fixed-size pool of worker threads running queued tasks in FIFO order.
+// Exceptions thrown by a task are rethrown from the future's get().
+class ThreadPool {
+public:
+  // threadCount == 0 uses one thread per hardware thread
+  explicit ThreadPool(unsigned threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template<typename F>
+  std::future<std::invoke_result_t<F>> submit(F task) {
+    using Result = std::invoke_result_t<F>;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    std::future<Result> future = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace([packaged]() { (*packaged)(); });
+    }
+    m_wakeUp.notify_one();
+    return future;
+  }
+
+  unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+  // Number of hardware threads, never less than 1
+  static unsigned defaultThreadCount();
+
+private:
+  std::vector<std::thread> m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  bool m_stopping = false;
+
+  void workerLoop();
+};
+
+}
+
+#endif // THREAD_POOL_H
@@ -9,6 +9,58 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+namespace {
+
+// A fresh JIT, module and function tables, with a parser pulling tokens from
+// the source on demand
+struct Session {
+  DecafScanning::Lexer lexer;
+  DecafParsing::Parser parser;
+
+  explicit Session(std::string source) : lexer(std::move(source)), parser(lexer) {
+    DecafLogger::Logger::enableTracesFromEnvironment();
+    DecafJIT::JIT::initJIT();
+    DecafCodeGen::CodeGenerator::reset();
+    DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
+  }
+
+  // Generate and optimize the next definition on its own
+  llvm::Function* codegenNext() {
+    DecafParsing::AST::Function* function = parser.parseFuncDefinition();
+    REQUIRE( function );
+    llvm::Function* functionIR = function->codegen();
+    REQUIRE( functionIR );
+    return functionIR;
+  }
+};
+
+// Compile a whole program at the given level and return the values of its top-level statements
+std::vector<double> compileAndRun(std::string source, DecafCodeGen::OptLevel optLevel = DecafCodeGen::OptLevel::O2) {
+  DecafCodeGen::CodeGenerator::optLevel = optLevel;
+  Session session(std::move(source));
+  std::vector<double> results = DecafJIT::handleProgram(&session.parser);
+  DecafLogger::Logger::reportDiagnostics(session.parser.diagnostics());
+  DecafLogger::Logger::reportDiagnostics(DecafCodeGen::CodeGenerator::resolver.diagnostics());
+  DecafCodeGen::CodeGenerator::optLevel = DecafCodeGen::OptLevel::O2;
+
+  REQUIRE( !session.parser.hasErrors() );
+  REQUIRE( !DecafCodeGen::CodeGenerator::resolver.hasErrors() );
+  return results;
+}
+
+template <typename Predicate>
+bool containsInstruction(llvm::Function* F, Predicate predicate) {
+  for (llvm::BasicBlock& BB : *F) {
+    for (llvm::Instruction& I : BB) {
+      if (predicate(I))
+        return true;
+    }
+  }
+  return false;
+}
+
+}
+
 // unsigned int Factorial( unsigned int number ) {
 //     return number <= 1 ? number : Factorial(number-1)*number;
 // }
@@ -29,29 +81,194 @@ TEST_CASE( "Test compiler support for function defintions and top-level statemen
   //     "fib(40)\n";
   std::string content = DecafIO::readFileToString("/Users/rachitkakkar/Documents/Projects/CPP/Decaf-Compiler/tests/test6.decaf");
   // std::cout << content << std::endl;
+  DecafLogger::Logger::enableTracesFromEnvironment();
   DecafScanning::Lexer lexer(content);
-  std::vector<DecafScanning::Token> tokens(lexer.tokenize());
-  // DecafLogger::Logger::displayTokenList(tokens);
-  DecafParsing::Parser parser(tokens);
-  std::unique_ptr<DecafParsing::AST::Function> AST;
+  // DecafLogger::Logger::displayTokenList(lexer.tokenize(), lexer.source());
+  DecafParsing::Parser parser(lexer); // Tokens are lexed on demand as the parser pulls them
 
   DecafJIT::JIT::initJIT();
+  DecafCodeGen::CodeGenerator::reset();
   DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
 
   double result = 0.0;
   while (!parser.isAtEnd()) {
     // Parse program consiting of functions or (To-do) top level declarations
-    switch (parser.peek().value().type) {
+    switch (parser.peek().type) {
       default:
         result = DecafJIT::handleTopLevelStatement(&parser);
+        break;
       case DecafScanning::TokenType::DEF:
         DecafJIT::handleFuncDefinition(&parser);
+        break;
     }
   }
+  DecafLogger::Logger::reportDiagnostics(parser.diagnostics());
 
+  REQUIRE( !parser.hasErrors() );
   REQUIRE( result == 102334155.0 );
 }
 
+TEST_CASE( "Test whole-program compilation with calls across definitions", "[whole program]" ) {
+  std::vector<double> results = compileAndRun(
+      "def fib(x) { if (less(x, 3)) { 1 } else { fib(x-1)+fib(x-2) } }\n"
+      "def less(a, b) { a < b }\n" // Defined after its caller
+      "fib(20)\n"
+      "fib(30)\n");
+  REQUIRE( results == std::vector<double> { 6765.0, 832040.0 } );
+}
+
+TEST_CASE( "Test that a whole program with errors runs none of its statements", "[whole program]" ) {
+  // The caller is generated before its callee fails, and the statement that
+  // fails comes between two good ones
+  for (const char* source : { "def twice(x) { half(x) * 4 }\ndef half(x) { y / 2 }\n1\ntwice(3)\n",
+                              "def twice(x) { x * 2 }\n1\ntwice(3, 4)\ntwice(2)\n" }) {
+    Session session(source);
+    REQUIRE( DecafJIT::handleProgram(&session.parser).empty() );
+    REQUIRE( !session.parser.hasErrors() );
+    REQUIRE( DecafCodeGen::CodeGenerator::resolver.diagnostics().size() == 1 );
+  }
+
+  // The module was dropped, so the next program starts clean
+  REQUIRE( compileAndRun("def twice(x) { x * 2 }\n1\ntwice(3)\n") == std::vector<double> { 1.0, 6.0 } );
+}
+
+TEST_CASE( "Test division and every comparison on ints and doubles", "[operators]" ) {
+  std::vector<double> results = compileAndRun(
+      "def int half(int n) { n / 2 }\n"
+      "def int compare(int a, int b) { (a > b) + 2 * (a >= b) + 4 * (a <= b) + 8 * (a == b) }\n"
+      "def compareDoubles(a, b) { (a > b) + 2 * (a >= b) + 4 * (a <= b) + 8 * (a == b) }\n"
+      "half(7)\n"
+      "compare(3, 3)\n"
+      "compare(4, 3)\n"
+      "compareDoubles(0.5, 1.5)\n"
+      "7.0 / 2\n");
+  REQUIRE( results == std::vector<double> { 3.0, 14.0, 3.0, 4.0, 3.5 } );
+}
+
+TEST_CASE( "Test that every optimization level computes the same results", "[optimization levels]" ) {
+  std::string content =
+      "def fib(x) { if (x < 3) { 1 } else { fib(x-1)+fib(x-2) } }\n"
+      "fib(25)\n";
+
+  for (std::string_view flag : { "-O0", "-O1", "-O2", "-O3", "-Os" }) {
+    std::optional<DecafCodeGen::OptLevel> level = DecafCodeGen::CodeGenerator::parseOptLevel(flag);
+    REQUIRE( level );
+    REQUIRE( compileAndRun(content, *level) == std::vector<double> { 75025.0 } );
+  }
+  REQUIRE( !DecafCodeGen::CodeGenerator::parseOptLevel("-O4") );
+}
+
+TEST_CASE( "Test loops that update local variables", "[locals]" ) {
+  std::vector<double> results = compileAndRun(
+      "def int sum(int n) { var int total = 0; while (0 < n) { total = total + n; n = n - 1 }; total }\n"
+      "def fib(x) { var a = 0; var b = 1; while (0 < x) { var next = a + b; a = b; b = next; x = x - 1 }; a }\n"
+      "sum(100)\n"
+      "fib(30)\n");
+  REQUIRE( results == std::vector<double> { 5050.0, 832040.0 } );
+}
+
+TEST_CASE( "Test element-wise loops over stack and heap arrays", "[arrays]" ) {
+  std::vector<double> results = compileAndRun(
+      "def dot(int n) {\n"
+      "  var x[1024]; var y[n]; var int i = 0;\n"
+      "  while (i < n) { x[i] = i; y[i] = 0.5 * i; i = i + 1 };\n"
+      "  var sum = 0; i = 0;\n"
+      "  while (i < n) { sum = sum + x[i] * y[i]; i = i + 1 };\n"
+      "  sum\n"
+      "}\n"
+      "dot(1000)\n");
+  // Sum of i * i / 2 for i below 1000
+  REQUIRE( results == std::vector<double> { 166416750.0 } );
+}
+
+TEST_CASE( "Test that loops in separately compiled functions are vectorized", "[loops]" ) {
+  Session session("def int fill(int n, int k) { var int a[n]; var int i = 0; while (i < n) { a[i] = 3 * i + k; i = i + 1 }; a[k] }\n");
+  llvm::Function* fillIR = session.codegenNext();
+
+  REQUIRE( containsInstruction(fillIR, [](llvm::Instruction& I) {
+    auto* store = llvm::dyn_cast<llvm::StoreInst>(&I);
+    return store && store->getValueOperand()->getType()->isVectorTy();
+  }) );
+}
+
+TEST_CASE( "Test that fast-math functions vectorize floating-point reductions", "[fast math]" ) {
+  Session session(
+      "def fast fastSum(int n) { var s = 0; var int i = 0; while (i < n) { s = s + 0.5 * i; i = i + 1 }; s }\n"
+      "def strictSum(int n) { var s = 0; var int i = 0; while (i < n) { s = s + 0.5 * i; i = i + 1 }; s }\n");
+  llvm::Function* fastIR = session.codegenNext();
+  llvm::Function* strictIR = session.codegenNext();
+
+  // Reassociating the sum is what lets it be split across vector lanes
+  auto vectorAdd = [](llvm::Instruction& I) {
+    return I.getOpcode() == llvm::Instruction::FAdd && I.getType()->isVectorTy();
+  };
+  REQUIRE( containsInstruction(fastIR, vectorAdd) );
+  REQUIRE( !containsInstruction(strictIR, vectorAdd) );
+}
+
+TEST_CASE( "Test that global fast-math flags all floating-point math and fuses it", "[fast math]" ) {
+  DecafCodeGen::CodeGenerator::fastMath = true;
+  Session session(
+      "def dot(int n) {\n"
+      "  var x[n]; var y[n]; var int i = 0;\n"
+      "  while (i < n) { x[i] = 0.5 * i; y[i] = 2.0 - 0.25 * i; i = i + 1 };\n"
+      "  var sum = 0; i = 0;\n"
+      "  while (i < n) { sum = sum + x[i] * y[i]; i = i + 1 };\n"
+      "  sum\n"
+      "}\n");
+  llvm::Function* dotIR = session.codegenNext();
+  bool fusedByJIT = DecafJIT::JIT::JIT_->getTargetMachine().Options.AllowFPOpFusion == llvm::FPOpFusion::Fast;
+  DecafCodeGen::CodeGenerator::fastMath = false;
+
+  // Every multiply and add of the dot product may be contracted into an FMA,
+  // and the reduction vectorized
+  auto isFloatingPoint = [](llvm::Instruction& I) {
+    return I.getOpcode() == llvm::Instruction::FMul || I.getOpcode() == llvm::Instruction::FAdd;
+  };
+  REQUIRE( containsInstruction(dotIR, isFloatingPoint) );
+  REQUIRE( !containsInstruction(dotIR, [&](llvm::Instruction& I) { return isFloatingPoint(I) && !I.isFast(); }) );
+  REQUIRE( containsInstruction(dotIR, [](llvm::Instruction& I) {
+    return I.getOpcode() == llvm::Instruction::FAdd && I.getType()->isVectorTy();
+  }) );
+  REQUIRE( fusedByJIT );
+}
+
+TEST_CASE( "Test that memoized functions cache their results by argument", "[memoization]" ) {
+  // fib(40) is about a billion calls without the table. The others return a
+  // bool and key on two arguments.
+  std::vector<double> results = compileAndRun(
+      "def memo fib(x) { if (x < 3) { 1 } else { fib(x-1)+fib(x-2) } }\n"
+      "def memo bool odd(int n) { if (n < 1) { false } else { if (odd(n - 1)) { false } else { true } } }\n"
+      "def memo int paths(int r, int c) { if (r < 1) { 1 } else { if (c < 1) { 1 } else { paths(r - 1, c) + paths(r, c - 1) } } }\n"
+      "fib(40)\n"
+      "odd(101)\n"
+      "paths(16, 16)\n");
+  REQUIRE( results == std::vector<double> { 102334155.0, 1.0, 601080390.0 } );
+
+  // The global switch memoizes pure functions without the annotation
+  DecafCodeGen::CodeGenerator::memoizePureFunctions = true;
+  std::string content =
+      "def fib(x) { if (x < 3) { 1 } else { fib(x-1)+fib(x-2) } }\n"
+      "def int paths(int r, int c) { if (r < 1) { 1 } else { if (c < 1) { 1 } else { paths(r - 1, c) + paths(r, c - 1) } } }\n";
+  Session session(content);
+  llvm::Function* fibIR = session.codegenNext();
+  llvm::Function* pathsIR = session.codegenNext();
+
+  // The wrapper takes the function's name and reads and writes the table
+  REQUIRE( fibIR->getName() == "fib" );
+  REQUIRE( DecafCodeGen::CodeGenerator::module_->getFunction("fib.impl") );
+  REQUIRE( !fibIR->doesNotAccessMemory() );
+  REQUIRE( pathsIR->getName() == "paths" );
+  llvm::GlobalVariable* keys = DecafCodeGen::CodeGenerator::module_->getNamedGlobal("paths.memo.keys");
+  REQUIRE( keys );
+  auto* keyRow = llvm::cast<llvm::ArrayType>(llvm::cast<llvm::ArrayType>(keys->getValueType())->getElementType());
+  REQUIRE( keyRow->getNumElements() == 2 );
+  REQUIRE( keyRow->getElementType()->isIntegerTy(64) );
+
+  REQUIRE( compileAndRun(content + "fib(40)\npaths(16, 16)\n") == std::vector<double> { 102334155.0, 601080390.0 } );
+  DecafCodeGen::CodeGenerator::memoizePureFunctions = false;
+}
+
 // int main(int argc, char* argv[]) {
 //   try {
 //     std::cout << "---------------------------------------------------------" << std::endl;
@@ -68,19 +285,17 @@ TEST_CASE( "Test compiler support for function defintions and top-level statemen
 //     DecafLogger::Logger::setFile(content);
 
 //     DecafScanning::Lexer lexer(content);
-//     std::vector<DecafScanning::Token> tokens(lexer.tokenize());
-//     DecafLogger::Logger::displayTokenList(tokens); // Display the tokens
+//     DecafLogger::Logger::displayTokenList(lexer.tokenize(), lexer.source()); // Display the tokens
 //     std::cout << std::endl;
 
-//     DecafParsing::Parser parser(tokens);
-//     std::unique_ptr<DecafParsing::AST::Function> AST;
+//     DecafParsing::Parser parser(lexer);
 
 //     DecafJIT::JIT::initJIT();
 //     DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
 
 //     while (!parser.isAtEnd()) {
 //       // Parse program consiting of functions or (To-do) top level declarations
-//       switch (parser.peek().value().type) {
+//       switch (parser.peek().type) {
 //         default:
 //           DecafJIT::handleTopLevelStatement(&parser);
 //         case DecafScanning::TokenType::DEF:
@@ -0,0 +1,45 @@
+#include "Arena.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+
+TEST_CASE( "Arena allocations are aligned and do not overlap", "[arena]" ) {
+  DecafMemory::Arena arena(256);
+
+  struct Node { double value; Node* next; };
+  Node* previous = nullptr;
+  for (int i = 0; i < 100; i++) {
+    arena.allocate(1, 1); // Misalign the cursor between nodes
+    Node* node = arena.make<Node>(Node { static_cast<double>(i), previous });
+    REQUIRE( reinterpret_cast<std::uintptr_t>(node) % alignof(Node) == 0 );
+    previous = node;
+  }
+
+  // Walk the list back; every node still holds the value it was created with
+  for (int i = 99; i >= 0; i--) {
+    REQUIRE( previous->value == static_cast<double>(i) );
+    previous = previous->next;
+  }
+  REQUIRE( previous == nullptr );
+}
+
+TEST_CASE( "Arena copies strings and oversized arrays", "[arena]" ) {
+  DecafMemory::Arena arena(64);
+
+  std::string source = "fib";
+  std::string_view copy = arena.copyString(source);
+  source[0] = 'x';
+  REQUIRE( copy == "fib" );
+
+  std::vector<int> values(1000);
+  for (int i = 0; i < 1000; i++)
+    values[i] = i;
+  std::span<int> array = arena.copyArray(std::span<const int>(values));
+  REQUIRE( std::equal(array.begin(), array.end(), values.begin(), values.end()) );
+
+  // Small allocations keep using the current block after an oversized one
+  std::size_t reserved = arena.reservedBytes();
+  arena.allocate(8, 8);
+  REQUIRE( arena.reservedBytes() == reserved );
+}
@@ -0,0 +1,96 @@
+#include "ConstantFolder.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+using namespace DecafParsing::AST;
+
+// Parse a single function definition, resolve and fold it
+struct Folded {
+  DecafScanning::Lexer lexer;
+  DecafParsing::Parser parser;
+  Function* function;
+  std::size_t removed;
+
+  explicit Folded(std::string source)
+    : lexer(std::move(source)), parser(lexer.tokenize(), lexer.source()) {
+    function = parser.parseFuncDefinition();
+    REQUIRE( function );
+    DecafParsing::Resolver().resolve(*function);
+    removed = DecafParsing::ConstantFolder().fold(*function);
+  }
+
+  double number() const {
+    REQUIRE( function->body->kind == ExprKind::NUMBER );
+    return static_cast<NumberExpr&>(*function->body).value;
+  }
+};
+
+}
+
+TEST_CASE( "Constant folder evaluates literal arithmetic and comparisons", "[optimizer]" ) {
+  CHECK( Folded("def f() { (2 + 3) * 4 - 1 }").number() == 19.0 );
+  CHECK( Folded("def f() { 1 < 2 }").number() == 1.0 );
+  CHECK( Folded("def f() { 1 < 2 }").function->body->type == ValueType::BOOL );
+  CHECK( Folded("def f() { 2 * 0.5 }").function->body->type == ValueType::DOUBLE );
+  CHECK( Folded("def f() { 2 < 1 }").number() == 0.0 );
+  CHECK( Folded("def f() { 3 >= 3 }").number() == 1.0 );
+  CHECK( Folded("def f() { 2 == 3 }").number() == 0.0 );
+  CHECK( Folded("def f() { 1.0 / 4 }").number() == 0.25 );
+  CHECK( Folded("def f() { 7 / 2 }").function->body->kind == ExprKind::BINARY ); // Truncates at run time
+
+  Folded partial("def f(x) { x * (2 + 3) }");
+  REQUIRE( partial.function->body->kind == ExprKind::BINARY );
+  auto& product = static_cast<BinaryExpr&>(*partial.function->body);
+  REQUIRE( product.RHS->kind == ExprKind::NUMBER );
+  CHECK( static_cast<NumberExpr&>(*product.RHS).value == 5.0 );
+  CHECK( partial.removed == 2 );
+}
+
+TEST_CASE( "Constant folder applies only exact identities", "[optimizer]" ) {
+  Folded timesOne("def f(x) { 1 * x * (3 - 2) }");
+  CHECK( timesOne.function->body->kind == ExprKind::VARIABLE );
+
+  Folded minusZero("def f(x) { x - 0 }");
+  CHECK( minusZero.function->body->kind == ExprKind::VARIABLE );
+
+  // Would turn -0.0 into 0.0
+  Folded plusZero("def f(x) { x + 0 }");
+  CHECK( plusZero.function->body->kind == ExprKind::BINARY );
+  CHECK( plusZero.removed == 0 );
+
+  // Would drop the conversion of the int to a double
+  Folded widening("def f(int n) { n * 1.0 }");
+  CHECK( widening.function->body->kind == ExprKind::BINARY );
+}
+
+TEST_CASE( "Constant folder leaves integer results it can't represent exactly", "[optimizer]" ) {
+  CHECK( Folded("def int f() { 4194304 * 4194304 }").number() == 0x1p44 );
+  CHECK( Folded("def int f() { 4503599627370495 * 2 + 1 }").number() == 0x1p53 - 1 );
+  // 2^53 itself could be the rounded result of 2^53 + 1
+  CHECK( Folded("def int f() { 4503599627370496 * 2 }").function->body->kind == ExprKind::BINARY );
+
+  // Wraps around at run time, which the doubles used for folding can't reproduce
+  Folded overflow("def int f() { 4294967296 * 4294967296 }");
+  CHECK( overflow.function->body->kind == ExprKind::BINARY );
+  CHECK( overflow.removed == 0 );
+}
+
+TEST_CASE( "Constant folder removes dead branches and loops", "[optimizer]" ) {
+  Folded taken("def f(x) { if (1 < 2) { x } else { x * x + 1 } }");
+  CHECK( taken.function->body->kind == ExprKind::VARIABLE );
+  CHECK( taken.removed == 9 ); // if, 1 < 2 (three nodes), else branch (five nodes)
+
+  Folded notTaken("def f(x) { if (0) { f(x) } else { 7 } }");
+  CHECK( notTaken.number() == 7.0 );
+
+  Folded deadLoop("def f(x) { while (3 < 2) { f(x - 1) } }");
+  CHECK( deadLoop.number() == 0.0 );
+  CHECK( deadLoop.removed == 7 ); // while, condition folding (two nodes), body (four nodes)
+
+  Folded liveLoop("def f(x) { while (x) { x - 1 } }");
+  CHECK( liveLoop.function->body->kind == ExprKind::WHILE );
+}
@@ -0,0 +1,76 @@
+#include "CodeGenerator.hpp"
+#include "JIT.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+// Floating-point heavy kernels: a dot product that may be vectorized and
+// fused, and a strict Horner polynomial that may be neither, so it shows
+// what is left without wider vectors and FMA
+const std::string kProgram =
+    "def fast dot(int n, int rounds) {\n"
+    "  var x[n]; var y[n]; var int i = 0;\n"
+    "  while (i < n) { x[i] = 0.5 * i; y[i] = 2.0 - 0.25 * i; i = i + 1 };\n"
+    "  var sum = 0; var int r = 0;\n"
+    "  while (r < rounds) { i = 0; while (i < n) { sum = sum + x[i] * y[i]; i = i + 1 }; r = r + 1 };\n"
+    "  sum\n"
+    "}\n"
+    "def horner(int n) {\n"
+    "  var acc = 0; var int i = 0;\n"
+    "  while (i < n) { var t = 0.000001 * i; acc = acc + ((((3 * t + 2) * t - 5) * t + 7) * t - 1); i = i + 1 };\n"
+    "  acc\n"
+    "}\n"
+    "dot(4096, 20000)\n"
+    "horner(50000000)\n";
+
+// Compile the definitions, then time the top-level statements that run them
+std::vector<double> runProgram(double& milliseconds) {
+  DecafScanning::Lexer lexer(kProgram);
+  DecafParsing::Parser parser(lexer);
+  DecafJIT::JIT::initJIT();
+  DecafCodeGen::CodeGenerator::reset();
+  DecafCodeGen::CodeGenerator::initializeModuleAndPassManager();
+
+  std::vector<double> results;
+  milliseconds = 0.0;
+  while (!parser.isAtEnd()) {
+    if (parser.peek().type == DecafScanning::TokenType::DEF) {
+      DecafJIT::handleFuncDefinition(&parser);
+      continue;
+    }
+    auto start = std::chrono::steady_clock::now();
+    results.push_back(DecafJIT::handleTopLevelStatement(&parser));
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    milliseconds += elapsed.count();
+  }
+  REQUIRE( !parser.hasErrors() );
+  return results;
+}
+
+}
+
+TEST_CASE( "JIT run time of floating-point code for a generic and the host CPU", "[.][benchmark][jit]" ) {
+  double genericTime = 0.0, hostTime = 0.0;
+
+  DecafJIT::JIT::targetHostCPU = false;
+  std::vector<double> generic = runProgram(genericTime);
+  std::string genericCPU = DecafJIT::JIT::JIT_->getTargetMachine().getTargetCPU().str();
+
+  DecafJIT::JIT::targetHostCPU = true;
+  std::vector<double> host = runProgram(hostTime);
+  std::string hostCPU = DecafJIT::JIT::JIT_->getTargetMachine().getTargetCPU().str();
+
+  // Fast-math sums may round differently once they are vectorized more
+  // widely, but strict code computes the same on any CPU
+  REQUIRE( generic.size() == host.size() );
+  REQUIRE( generic.back() == host.back() );
+
+  std::printf("%-8s %10.1f ms (CPU %s)\n", "generic", genericTime, genericCPU.empty() ? "generic" : genericCPU.c_str());
+  std::printf("%-8s %10.1f ms (CPU %s, %.2fx)\n", "host", hostTime, hostCPU.c_str(), genericTime / hostTime);
+}
@@ -0,0 +1,78 @@
+#include "Lexer.hpp"
+#include "Logger.hpp"
+#include "ScanKernels.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+// Builds a multi-megabyte LaSIL source from a representative mix of long comments,
+// indentation, identifiers and numbers.
+std::string makeBenchmarkSource(std::size_t targetBytes) {
+  const std::string unit =
+      "# Compute the x'th fibonacci number recursively, memoizing nothing at all.\n"
+      "def fibonacci_recursive_helper(current_value, previous_value) {\n"
+      "        if (current_value < 3) {\n"
+      "                1\n"
+      "        }\n"
+      "        else {\n"
+      "                fibonacci_recursive_helper(current_value-1, 0)+fibonacci_recursive_helper(current_value-2, 0)\n"
+      "        }\n"
+      "}\n"
+      "\n"
+      "# This expression will compute a large number.\n"
+      "fibonacci_recursive_helper(1234567890, 9876543210)\n\n";
+  std::string source;
+  source.reserve(targetBytes + unit.size());
+  while (source.size() < targetBytes)
+    source += unit;
+  return source;
+}
+
+double measureThroughput(DecafScanning::Lexer& lexer, std::size_t bytes, std::size_t& tokenCount,
+                         DecafScanning::LexMode mode = DecafScanning::LexMode::SINGLE_THREADED) {
+  constexpr int iterations = 10;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+    tokenCount = lexer.tokenize(mode).size();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return (static_cast<double>(bytes) * iterations / (1024.0 * 1024.0)) / elapsed.count();
+}
+
+}
+
+TEST_CASE( "Lexer throughput of the scalar and vectorized scan kernels", "[.][benchmark][lexer]" ) {
+  std::string source = makeBenchmarkSource(32 * 1024 * 1024);
+  DecafScanning::Lexer lexer(source);
+  DecafScanning::ScanKernelKind best = DecafScanning::ScanKernels::detect();
+
+  REQUIRE( DecafScanning::ScanKernels::select(DecafScanning::ScanKernelKind::SCALAR) );
+  std::vector<DecafScanning::Token> expected = lexer.tokenize();
+
+  for (auto kind : { DecafScanning::ScanKernelKind::SCALAR, DecafScanning::ScanKernelKind::SSE2,
+                     DecafScanning::ScanKernelKind::AVX2, DecafScanning::ScanKernelKind::NEON }) {
+    if (!DecafScanning::ScanKernels::select(kind))
+      continue;
+
+    std::vector<DecafScanning::Token> tokens = lexer.tokenize();
+    bool identical = std::equal(tokens.begin(), tokens.end(), expected.begin(), expected.end(),
+      [](const DecafScanning::Token& a, const DecafScanning::Token& b) {
+        return a.type == b.type && a.position == b.position && a.length == b.length;
+      });
+    REQUIRE( identical );
+
+    std::size_t tokenCount = 0;
+    double throughput = measureThroughput(lexer, source.size(), tokenCount);
+    std::printf("%-8s %8.1f MB/s (%zu tokens)\n", std::string(DecafScanning::ScanKernels::name(kind)).c_str(), throughput, tokenCount);
+  }
+
+  DecafScanning::ScanKernels::select(best);
+  std::size_t tokenCount = 0;
+  double throughput = measureThroughput(lexer, source.size(), tokenCount, DecafScanning::LexMode::PARALLEL);
+  std::printf("%-8s %8.1f MB/s (%zu tokens, %s kernel, %u threads)\n", "parallel", throughput, tokenCount,
+              std::string(DecafScanning::ScanKernels::name(best)).c_str(), std::thread::hardware_concurrency());
+}
@@ -0,0 +1,129 @@
+#include "Lexer.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+bool sameTokens(const std::vector<DecafScanning::Token>& a, const std::vector<DecafScanning::Token>& b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const DecafScanning::Token& x, const DecafScanning::Token& y) {
+    return x.type == y.type && x.position == y.position && x.length == y.length;
+  });
+}
+
+}
+
+TEST_CASE( "Incremental re-lexing matches a full re-tokenize", "[lexer]" ) {
+  std::string content =
+      "# fib(2) computes the second number\n"
+      "def fib(x) {\n"
+      "  if (x < 3) {\n"
+      "    1\n"
+      "  }\n"
+      "  else {\n"
+      "    fib(x-1)+fib(x-2)\n"
+      "  }\n"
+      "}\n"
+      "\n"
+      "fib(40)\n";
+
+  struct Case { std::size_t offset; std::size_t removed; std::string_view inserted; };
+  const Case cases[] = {
+    { content.find("x < 3"), 1, "value" },          // Rename inside a line
+    { content.find("< 3"), 1, "<=" },               // Operator merges with following text
+    { content.find("fib(x-1)"), 0, "# " },          // Comment out the rest of a line
+    { content.find("# fib(2)"), 2, "" },            // Uncomment a line
+    { content.find("\n\nfib"), 1, "" },             // Join two lines
+    { content.size(), 0, "\nfib(10)" },             // Append at the end
+  };
+
+  for (const Case& edit : cases) {
+    DecafScanning::Lexer lexer(content);
+    std::vector<DecafScanning::Token> tokens = lexer.tokenize();
+    DecafScanning::TokenRange changed = lexer.relex(tokens, { edit.offset, edit.removed, edit.inserted });
+
+    std::string edited = content;
+    edited.replace(edit.offset, edit.removed, edit.inserted);
+    DecafScanning::Lexer fresh(edited);
+
+    REQUIRE( lexer.source() == fresh.source() );
+    REQUIRE( sameTokens(tokens, fresh.tokenize()) );
+    REQUIRE( changed.first <= changed.newEnd );
+  }
+}
+
+TEST_CASE( "Re-lexing an invalid character reports it and keeps the tokens in sync", "[lexer]" ) {
+  std::string content = "def f(x) { x + 1 }\n$\nf(2)\n";
+  DecafScanning::Lexer lexer(content);
+  std::vector<DecafScanning::Token> tokens = lexer.tokenize();
+  REQUIRE( lexer.diagnostics().size() == 1 );
+
+  // Insert another invalid character before the existing one, then remove it again
+  std::size_t offset = content.find("+ 1");
+  lexer.relex(tokens, { offset, 0, "$ " });
+  content.replace(offset, 0, "$ ");
+  DecafScanning::Lexer fresh(content);
+  REQUIRE( sameTokens(tokens, fresh.tokenize()) );
+  REQUIRE( lexer.diagnostics().size() == 2 );
+  for (std::size_t i = 0; i < 2; i++) {
+    REQUIRE( lexer.diagnostics()[i].position == fresh.diagnostics()[i].position );
+    REQUIRE( lexer.diagnostics()[i].message == fresh.diagnostics()[i].message );
+  }
+
+  lexer.relex(tokens, { offset, 2, "" });
+  content.replace(offset, 2, "");
+  REQUIRE( sameTokens(tokens, DecafScanning::Lexer(content).tokenize()) );
+  REQUIRE( lexer.diagnostics().size() == 1 );
+  REQUIRE( lexer.diagnostics()[0].position == content.find('$') );
+}
+
+TEST_CASE( "Reserved keywords are reported as warnings among the errors", "[lexer]" ) {
+  DecafScanning::Lexer lexer("def f(new) { $ new + class }\n");
+  std::vector<DecafScanning::Token> tokens = lexer.tokenize();
+  REQUIRE( tokens[3].type == DecafScanning::TokenType::IDENTIFIER );
+
+  const std::vector<DecafLogger::Diagnostic>& diagnostics = lexer.diagnostics();
+  REQUIRE( diagnostics.size() == 4 );
+  REQUIRE( diagnostics[0].type == DecafLogger::LogType::WARNING );
+  REQUIRE( diagnostics[1].type == DecafLogger::LogType::ERROR );
+  REQUIRE( diagnostics[2].type == DecafLogger::LogType::WARNING );
+  REQUIRE( diagnostics[3].message == "Reserved keyword 'class' used as identifier! This can cause issues in later versions of the compiler." );
+  for (std::size_t i = 1; i < diagnostics.size(); i++)
+    REQUIRE( diagnostics[i - 1].position < diagnostics[i].position );
+
+  // Each chunk collects its own, and they are merged in source order
+  std::string content;
+  while (content.size() < 4 * 1024 * 1024)
+    content += "def f(this) { this + 1 }\n";
+  DecafScanning::Lexer large(content);
+  large.tokenize();
+  std::vector<DecafLogger::Diagnostic> expected = large.diagnostics();
+  large.tokenize(DecafScanning::LexMode::PARALLEL, 4);
+  REQUIRE( std::equal(expected.begin(), expected.end(), large.diagnostics().begin(), large.diagnostics().end(),
+                      [](const DecafLogger::Diagnostic& a, const DecafLogger::Diagnostic& b) { return a.position == b.position; }) );
+}
+
+TEST_CASE( "Numeric literals are converted exactly by the lexer", "[lexer]" ) {
+  DecafScanning::Lexer lexer("3 0.1 2.5e3 1E-2 0x1F 0x1.8p1 1ex");
+  std::vector<DecafScanning::Token> tokens = lexer.tokenize();
+
+  REQUIRE( tokens.size() == 8 );
+  REQUIRE( tokens[0].number == 3.0 );
+  REQUIRE( tokens[1].number == 0.1 ); // Nearest double, not a float widened to double
+  REQUIRE( tokens[2].number == 2500.0 );
+  REQUIRE( tokens[3].number == 0.01 );
+  REQUIRE( tokens[4].number == 31.0 );
+  REQUIRE( tokens[5].number == 3.0 );
+  REQUIRE( tokens[6].number == 1.0 ); // 'e' without exponent digits starts an identifier
+  REQUIRE( tokens[7].type == DecafScanning::TokenType::IDENTIFIER );
+}
+
+TEST_CASE( "Parallel lexing produces the same tokens as single-threaded lexing", "[lexer]" ) {
+  // Long enough to be split into several chunks, with comments and CRLF line breaks around the split points
+  std::string content;
+  while (content.size() < 8 * 1024 * 1024)
+    content += "# helper(1, 2) is commented out\r\ndef helper(a, b) {\n  if (a <= 0x10) { a * 2.5e1 } else { helper(a - 1, b) }\n}\n";
+  DecafScanning::Lexer lexer(content);
+
+  REQUIRE( sameTokens(lexer.tokenize(DecafScanning::LexMode::PARALLEL, 4), lexer.tokenize()) );
+  REQUIRE( sameTokens(lexer.tokenize(DecafScanning::LexMode::PARALLEL, 3), lexer.tokenize()) );
+}
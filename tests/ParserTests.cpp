@@ -0,0 +1,339 @@
+#include "Parser.hpp"
+#include "Resolver.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+bool sameExpr(DecafParsing::AST::Expr& a, DecafParsing::AST::Expr& b) {
+  using namespace DecafParsing::AST;
+  if (a.kind != b.kind)
+    return false;
+  switch (a.kind) {
+    case ExprKind::NUMBER:
+      if (static_cast<NumberExpr&>(a).value != static_cast<NumberExpr&>(b).value)
+        return false;
+      break;
+    case ExprKind::VARIABLE:
+      if (static_cast<VariableExpr&>(a).name != static_cast<VariableExpr&>(b).name)
+        return false;
+      break;
+    case ExprKind::BINARY:
+      if (static_cast<BinaryExpr&>(a).op.type != static_cast<BinaryExpr&>(b).op.type)
+        return false;
+      break;
+    case ExprKind::CALL:
+      if (static_cast<CallExpr&>(a).callee != static_cast<CallExpr&>(b).callee)
+        return false;
+      break;
+    case ExprKind::VAR:
+      if (static_cast<VarExpr&>(a).name != static_cast<VarExpr&>(b).name)
+        return false;
+      break;
+    case ExprKind::INDEX:
+      if (static_cast<IndexExpr&>(a).name != static_cast<IndexExpr&>(b).name)
+        return false;
+      break;
+    case ExprKind::IF:
+    case ExprKind::WHILE:
+      break;
+  }
+
+  std::vector<Expr*> childrenA, childrenB;
+  forEachChild(a, [&](Expr& child) { childrenA.push_back(&child); });
+  forEachChild(b, [&](Expr& child) { childrenB.push_back(&child); });
+  return std::equal(childrenA.begin(), childrenA.end(), childrenB.begin(), childrenB.end(),
+                    [](Expr* x, Expr* y) { return sameExpr(*x, *y); });
+}
+
+// Parse a program and resolve its functions in order, as code generation does
+struct Parsed {
+  DecafScanning::Lexer lexer;
+  DecafParsing::Parser parser;
+  std::vector<DecafParsing::AST::Function*> functions;
+  DecafParsing::Resolver resolver;
+
+  explicit Parsed(std::string source)
+    : lexer(std::move(source)), parser(lexer.tokenize(), lexer.source()), functions(parser.parseProgram()) {
+    for (DecafParsing::AST::Function* function : functions) {
+      resolver.resolve(*function);
+      resolver.markTailCalls(*function);
+    }
+  }
+};
+
+}
+
+TEST_CASE( "Parallel parsing produces the same functions as single-threaded parsing", "[parser]" ) {
+  std::string content;
+  for (int i = 0; content.size() < 256 * 1024; i++) {
+    std::string name = "f" + std::to_string(i);
+    content += "def " + name + "(x, y) {\n  if (x < 3) { " + name + "(x - 1, y) * 2 } else { while (y) { y - 1 } }\n}\n";
+    if (i % 7 == 0)
+      content += name + "(1, 2)\n";
+  }
+  DecafScanning::Lexer lexer(content);
+
+  DecafParsing::Parser sequential(lexer.tokenize(), lexer.source());
+  DecafParsing::Parser parallel(lexer.tokenize(), lexer.source());
+  std::vector<DecafParsing::AST::Function*> expected = sequential.parseProgram();
+  std::vector<DecafParsing::AST::Function*> actual = parallel.parseProgram(DecafParsing::ParseMode::PARALLEL, 4);
+
+  REQUIRE( actual.size() == expected.size() );
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    REQUIRE( actual[i]->proto->name == expected[i]->proto->name );
+    REQUIRE( actual[i]->proto->args.size() == expected[i]->proto->args.size() );
+    REQUIRE( sameExpr(*actual[i]->body, *expected[i]->body) );
+  }
+}
+
+TEST_CASE( "Parser reports every broken unit and recovers at the next one", "[parser]" ) {
+  std::string content =
+      "def good(x) { x * 2 }\n"
+      "def missingBrace(x) { x + }\n"
+      "def alsoGood(y) { y }\n"
+      "good(1 2)\n"
+      "alsoGood(3)\n"
+      "def badChar(x) { x $ }\n"
+      "def missingName() { (1 + 2 }\n"
+      "good(4)\n";
+  DecafScanning::Lexer lexer(content);
+
+  for (bool streaming : { true, false }) {
+    DecafParsing::Parser parser = streaming ? DecafParsing::Parser(lexer) : DecafParsing::Parser(lexer.tokenize(), lexer.source());
+    std::vector<DecafParsing::AST::Function*> functions = parser.parseProgram();
+
+    std::vector<std::string_view> names;
+    for (DecafParsing::AST::Function* function : functions)
+      names.push_back(function->proto->getName());
+    // The lexer drops the bad character, so only a streaming parser sees badChar fail
+    if (streaming)
+      REQUIRE( names == std::vector<std::string_view> { "good", "alsoGood", "__anon_expr", "__anon_expr" } );
+    else
+      REQUIRE( names == std::vector<std::string_view> { "good", "alsoGood", "__anon_expr", "badChar", "__anon_expr" } );
+
+    // Lexer errors are part of the parser's diagnostics when streaming, and of the lexer's otherwise
+    std::vector<DecafLogger::Diagnostic> diagnostics = parser.diagnostics();
+    if (!streaming) {
+      REQUIRE( lexer.diagnostics().size() == 1 );
+      diagnostics.insert(diagnostics.begin() + 2, lexer.diagnostics().front());
+    }
+    REQUIRE( diagnostics.size() == 4 );
+    REQUIRE( diagnostics[0].position == content.find("}\ndef alsoGood") );
+    REQUIRE( diagnostics[1].position == content.find("2)") );
+    REQUIRE( diagnostics[2].message == "Unrecognized character: $" );
+    REQUIRE( diagnostics[3].position == content.find("}\ngood(4)") );
+  }
+}
+
+TEST_CASE( "A streaming parser collects the lexer's warnings without failing", "[parser]" ) {
+  DecafScanning::Lexer lexer("def f(new) { new * 2 }\nf(1)\n");
+  DecafParsing::Parser parser(lexer);
+  REQUIRE( parser.parseProgram().size() == 2 );
+
+  REQUIRE( parser.diagnostics().size() == 2 );
+  for (const DecafLogger::Diagnostic& diagnostic : parser.diagnostics())
+    REQUIRE( diagnostic.type == DecafLogger::LogType::WARNING );
+  REQUIRE( !parser.hasErrors() );
+}
+
+TEST_CASE( "Resolver binds variables to argument slots and calls to function IDs", "[parser]" ) {
+  Parsed program(
+      "def square(x) { x * x }\n"
+      "def sumOfSquares(a, b) { square(a) + square(b) }\n"
+      "def later(n) { undefinedYet(n) }\n");
+  std::vector<DecafParsing::AST::Function*>& functions = program.functions;
+  REQUIRE( functions.size() == 3 );
+
+  using namespace DecafParsing::AST;
+  REQUIRE( functions[0]->proto->function == 0 );
+  REQUIRE( functions[1]->proto->function == 1 );
+  REQUIRE( functions[2]->proto->function == 2 );
+  // Forward references get an ID of their own
+  REQUIRE( static_cast<CallExpr&>(*functions[2]->body).function == 3 );
+  REQUIRE( program.resolver.functionCount() == 4 );
+
+  auto& sum = static_cast<BinaryExpr&>(*functions[1]->body);
+  auto& left = static_cast<CallExpr&>(*sum.LHS);
+  auto& right = static_cast<CallExpr&>(*sum.RHS);
+  REQUIRE( left.function == functions[0]->proto->function );
+  REQUIRE( right.function == functions[0]->proto->function );
+  REQUIRE( static_cast<VariableExpr&>(*left.args[0]).slot == 0 );
+  REQUIRE( static_cast<VariableExpr&>(*right.args[0]).slot == 1 );
+
+  // Symbols are shared, so the same name always interns to the same ID
+  REQUIRE( static_cast<VariableExpr&>(*left.args[0]).name == DecafScanning::Interner::intern("a") );
+  REQUIRE( DecafScanning::Interner::name(functions[0]->proto->name) == "square" );
+}
+
+TEST_CASE( "Resolver types expressions from annotations and literals", "[parser]" ) {
+  Parsed program(
+      "def int count(int n, bool odd, x) { if (odd) { n + 1 } else { n * 2 } }\n"
+      "def fast bool small(int n) { n < 10 }\n"
+      "def mixed(int n) { count(n, true, 1.5) + 0.5 }\n"
+      "def memo fast half(x) { x / 2 }\n");
+  std::vector<DecafParsing::AST::Function*>& functions = program.functions;
+  REQUIRE( functions.size() == 4 );
+
+  using namespace DecafParsing::AST;
+  Prototype& count = *functions[0]->proto;
+  REQUIRE( count.returnType == ValueType::INT );
+  REQUIRE( count.argTypes.size() == 3 );
+  REQUIRE( count.argTypes[0] == ValueType::INT );
+  REQUIRE( count.argTypes[1] == ValueType::BOOL );
+  REQUIRE( count.argTypes[2] == ValueType::DOUBLE );
+
+  auto& ifExpr = static_cast<IfExpr&>(*functions[0]->body);
+  REQUIRE( ifExpr.cond->type == ValueType::BOOL );
+  REQUIRE( ifExpr.then->type == ValueType::INT ); // Integer literals stay ints
+  REQUIRE( ifExpr.type == ValueType::INT );
+
+  REQUIRE( functions[1]->body->type == ValueType::BOOL );
+  REQUIRE( functions[1]->proto->fastMath ); // The opt-in comes before the return type
+  REQUIRE( !count.fastMath );
+  REQUIRE( functions[3]->proto->memoize ); // Opt-ins combine in either order
+  REQUIRE( functions[3]->proto->fastMath );
+  REQUIRE( !functions[1]->proto->memoize );
+
+  auto& sum = static_cast<BinaryExpr&>(*functions[2]->body);
+  REQUIRE( sum.LHS->type == ValueType::INT ); // The call returns count's type
+  REQUIRE( static_cast<CallExpr&>(*sum.LHS).args[1]->type == ValueType::BOOL );
+  REQUIRE( sum.type == ValueType::DOUBLE );
+
+  // Integer literals stay ints only while the double they were read into is exact
+  Parsed large(
+      "def largest() { 9007199254740991 }\n"
+      "def rounded() { 9007199254740993 }\n");
+  REQUIRE( large.functions.size() == 2 );
+  REQUIRE( large.functions[0]->body->type == ValueType::INT );
+  REQUIRE( large.functions[1]->body->type == ValueType::DOUBLE );
+}
+
+TEST_CASE( "Resolver marks calls in tail position", "[parser]" ) {
+  Parsed program(
+      "def count(x, n) { if (x < 1) { n } else { count(x - 1, n + 1) } }\n"
+      "def int twice(int x) { if (x < 1) { other(x) } else { 2 * twice(x - 1) } }\n"
+      "def int widen(int x) { if (x < 1) { 1.5 } else { widen(x - 1) } }\n");
+  std::vector<DecafParsing::AST::Function*>& functions = program.functions;
+  REQUIRE( functions.size() == 3 );
+
+  using namespace DecafParsing::AST;
+  auto& count = static_cast<IfExpr&>(*functions[0]->body);
+  REQUIRE( static_cast<CallExpr&>(*count.else_).tail );
+  REQUIRE( functions[0]->selfTailCalls );
+
+  // The call to an unknown function returns a double that is converted to an int
+  auto& twice = static_cast<IfExpr&>(*functions[1]->body);
+  REQUIRE( !static_cast<CallExpr&>(*twice.then).tail );
+  REQUIRE( !static_cast<CallExpr&>(*static_cast<BinaryExpr&>(*twice.else_).RHS).tail );
+  REQUIRE( !functions[1]->selfTailCalls );
+
+  // The if is a double, so the int returned by the call is converted
+  auto& widen = static_cast<IfExpr&>(*functions[2]->body);
+  REQUIRE( !static_cast<CallExpr&>(*widen.else_).tail );
+}
+
+TEST_CASE( "Locals are scoped to the rest of their sequence and assignable", "[parser]" ) {
+  Parsed program(
+      "def int sum(int n) { var int total = 0; var i = n; while (0 < i) { total = total + i; i = i - 1 }; total }\n"
+      "def shadow(x) { var x = x + 1; x }\n"
+      "def chain(a, b) { a = b = 2; a + b }\n"
+      "def bad(x) { x + 1 = 2 }\n"
+      "def undeclared(x) { y = x }\n");
+  std::vector<DecafParsing::AST::Function*>& functions = program.functions;
+  REQUIRE( functions.size() == 4 );
+  REQUIRE( program.parser.diagnostics().size() == 1 );
+  REQUIRE( program.parser.diagnostics()[0].message == "Expected a variable before '='" );
+  REQUIRE( program.resolver.diagnostics().size() == 1 );
+  REQUIRE( program.resolver.diagnostics()[0].message == "Can't assign to 'y', which is not a variable in scope" );
+
+  using namespace DecafParsing::AST;
+  // Locals take the slots after the arguments and keep their declared type
+  REQUIRE( functions[0]->slotCount == 3 );
+  auto& total = static_cast<VarExpr&>(*functions[0]->body);
+  auto& i = static_cast<VarExpr&>(*total.body);
+  REQUIRE( total.slot == 1 );
+  REQUIRE( i.slot == 2 );
+  REQUIRE( i.varType == ValueType::DOUBLE );
+  auto& loop = static_cast<BinaryExpr&>(*i.body);
+  REQUIRE( loop.op.type == DecafScanning::TokenType::SEMICOLON );
+  REQUIRE( static_cast<VariableExpr&>(*loop.RHS).slot == 1 );
+  REQUIRE( total.type == ValueType::INT );
+  auto& update = static_cast<BinaryExpr&>(*static_cast<WhileExpr&>(*loop.LHS).body);
+  auto& assign = static_cast<BinaryExpr&>(*update.LHS);
+  REQUIRE( assign.op.type == DecafScanning::TokenType::EQUAL );
+  REQUIRE( assign.type == ValueType::INT ); // The double sum is converted to the local's type
+
+  // The initializer still sees the argument the local shadows
+  auto& shadow = static_cast<VarExpr&>(*functions[1]->body);
+  REQUIRE( static_cast<VariableExpr&>(*static_cast<BinaryExpr&>(*shadow.init).LHS).slot == 0 );
+  REQUIRE( static_cast<VariableExpr&>(*shadow.body).slot == 1 );
+
+  // Assignments chain to the right
+  auto& chain = static_cast<BinaryExpr&>(*static_cast<BinaryExpr&>(*functions[2]->body).LHS);
+  REQUIRE( chain.op.type == DecafScanning::TokenType::EQUAL );
+  REQUIRE( static_cast<BinaryExpr&>(*chain.RHS).op.type == DecafScanning::TokenType::EQUAL );
+}
+
+TEST_CASE( "Arrays are indexed by element and only scalars are used as values", "[parser]" ) {
+  Parsed program(
+      "def sum(int n) { var v[8]; var int w[n]; v[1] = w[n - 1] = 2; v[1] + w[0] }\n"
+      "def misuse(x) { var a[4]; a + x[0] }\n"
+      "def flags() { var bool b[2]; 0 }\n"
+      "def sizes(x) { var a[2.5]; var b[x]; var c[100000]; 0 }\n");
+  std::vector<DecafParsing::AST::Function*>& functions = program.functions;
+  REQUIRE( functions.size() == 3 );
+  REQUIRE( program.parser.diagnostics().size() == 1 );
+  REQUIRE( program.parser.diagnostics()[0].message == "Arrays hold doubles or ints" );
+
+  using namespace DecafParsing::AST;
+  auto& v = static_cast<VarExpr&>(*functions[0]->body);
+  auto& w = static_cast<VarExpr&>(*v.body);
+  REQUIRE( v.array );
+  REQUIRE( !v.onHeap() ); // The size is a literal
+  REQUIRE( w.onHeap() );
+  REQUIRE( w.varType == ValueType::INT );
+
+  auto& assign = static_cast<BinaryExpr&>(*static_cast<BinaryExpr&>(*w.body).LHS);
+  auto& element = static_cast<IndexExpr&>(*assign.LHS);
+  REQUIRE( element.slot == v.slot );
+  REQUIRE( assign.type == ValueType::DOUBLE );
+  REQUIRE( static_cast<BinaryExpr&>(*assign.RHS).type == ValueType::INT );
+
+  auto& misuse = static_cast<BinaryExpr&>(*static_cast<VarExpr&>(*functions[1]->body).body);
+  REQUIRE( static_cast<VariableExpr&>(*misuse.LHS).slot == kUnresolved );
+  REQUIRE( static_cast<IndexExpr&>(*misuse.RHS).slot == kUnresolved );
+
+  // Sizes are whole numbers, and large arrays go on the heap even with a literal size
+  const std::vector<DecafLogger::Diagnostic>& errors = program.resolver.diagnostics();
+  REQUIRE( errors.size() == 4 );
+  REQUIRE( errors[0].message == "'a' is not a variable in scope" );
+  REQUIRE( errors[1].message == "'x' is not an array in scope" );
+  REQUIRE( errors[0].position < errors[1].position );
+  REQUIRE( errors[2].message == "Array size must be an int" );
+  REQUIRE( errors[3].message == "Array size must be an int" );
+  REQUIRE( errors[2].position < errors[3].position );
+  auto& large = static_cast<VarExpr&>(*static_cast<VarExpr&>(*static_cast<VarExpr&>(*functions[2]->body).body).body);
+  REQUIRE( large.onHeap() );
+}
+
+TEST_CASE( "Calls must name a function defined before them with all of its arguments", "[parser]" ) {
+  Parsed program(
+      "def int twice(int x) { x * 2 }\n"
+      "def early(x) { later(x) }\n"
+      "def later(x) { x }\n"
+      "def count(x) { twice(x, 1) + twice(x, x, x) }\n"
+      "def broken(x) { y }\n"
+      "def user(x) { broken(x) }\n");
+  REQUIRE( program.functions.size() == 6 );
+
+  // A function with errors can't be called either
+  const std::vector<DecafLogger::Diagnostic>& errors = program.resolver.diagnostics();
+  REQUIRE( errors.size() == 5 );
+  REQUIRE( errors[0].message == "Unknown function 'later'" );
+  REQUIRE( errors[1].message == "Wrong number of arguments to 'twice': expected 1, got 2" );
+  REQUIRE( errors[2].message == "Wrong number of arguments to 'twice': expected 1, got 3" );
+  REQUIRE( errors[1].position < errors[2].position );
+  REQUIRE( errors[3].message == "'y' is not a variable in scope" );
+  REQUIRE( errors[4].message == "Unknown function 'broken'" );
+}
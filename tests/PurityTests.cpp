@@ -0,0 +1,55 @@
+#include "Parser.hpp"
+#include "Purity.hpp"
+#include "Resolver.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+
+TEST_CASE( "Purity analysis infers effects from callees", "[analysis]" ) {
+  std::string content =
+      "def square(x) { x * x }\n"
+      "def fib(x) { if (x < 3) { 1 } else { fib(x - 1) + fib(x - 2) } }\n"
+      "def spin(x) { while (x) { square(x) } }\n"
+      "def early(x) { later(x) }\n"
+      "def later(x) { x }\n"
+      "def constant() { square(2) }\n";
+  DecafScanning::Lexer lexer(content);
+  DecafParsing::Parser parser(lexer.tokenize(), lexer.source());
+  std::vector<DecafParsing::AST::Function*> functions = parser.parseProgram();
+  REQUIRE( functions.size() == 6 );
+
+  for (bool memoize : { false, true }) {
+    DecafParsing::Resolver resolver;
+    DecafParsing::PurityAnalysis purity;
+    std::vector<DecafParsing::FunctionEffects> effects;
+    for (DecafParsing::AST::Function* function : functions) {
+      resolver.resolve(*function);
+      effects.push_back(purity.analyze(*function, memoize));
+    }
+
+    auto [square, fib, spin, early, later, constant] = std::array { effects[0], effects[1], effects[2], effects[3], effects[4], effects[5] };
+    REQUIRE( square.pure );
+    REQUIRE( square.willReturn );
+    REQUIRE( square.memoized == memoize );
+
+    // Direct recursion keeps a function pure, but it may not terminate
+    REQUIRE( fib.pure );
+    REQUIRE( !fib.willReturn );
+    REQUIRE( fib.memoized == memoize );
+
+    REQUIRE( spin.pure );
+    REQUIRE( !spin.willReturn );
+
+    // The callee was unknown when the caller was analyzed
+    REQUIRE( !early.pure );
+    REQUIRE( !early.memoized );
+    REQUIRE( later.pure );
+
+    // Functions without arguments aren't memoized, but a memo table in a callee is memory access
+    REQUIRE( constant.pure );
+    REQUIRE( !constant.memoized );
+    REQUIRE( constant.accessesMemory == memoize );
+    REQUIRE( square.accessesMemory == memoize );
+  }
+}